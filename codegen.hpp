@@ -0,0 +1,499 @@
+#ifndef INCLUDED_CODEGEN_HPP
+#define INCLUDED_CODEGEN_HPP
+
+#include "lambda.hpp"
+#include "reducer.hpp"
+#include <cstddef>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Ahead-of-time translation of a script into a standalone C++ program.
+// Every abstraction becomes a function over its argument thunk and the thunks
+// it captures, every non-trivial argument a thunk function, and every
+// definition a lazily evaluated global. Names resolve as on the VM, which
+// keeps each definition as reduced on its own line: names defined before it
+// are part of it, and a name it leaves free is looked up on the line using it
+// only if it is ordered after the definition's name, as evaluate() substitutes
+// definitions in name order. The program prints what the interpreter prints
+// up to the names of bound variables, which are read back fresh as on the VM.
+namespace codegen
+{
+    // lazy thunks updated once forced, closures, neutral terms and read-back
+    const char *runtime = R"runtime(#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct Thunk;
+struct Spine;
+
+struct Value
+{
+    Value (*fn)(Thunk **, Thunk *); // closure code, null for a neutral term
+    Thunk **env;                    // thunks captured by the closure
+    std::uint32_t head;             // closure: binder symbol; neutral: symbol, or level_bit | level
+    const Spine *args;              // neutral: arguments, last first
+};
+
+struct Spine
+{
+    Thunk *arg;
+    const Spine *next;
+};
+
+struct Thunk
+{
+    Value (*code)(Thunk **);
+    Thunk **env;
+    bool done;
+    Value value;
+};
+
+const std::uint32_t level_bit = 0x80000000u;
+
+extern const char *symbols[];
+extern std::size_t introduced[]; // line a symbol first occurs on as a free name, 0 for binders only
+extern std::size_t symbol_count;
+std::size_t line = 0;
+
+inline Value force(Thunk *t)
+{
+    if (!t->done)
+    {
+        t->value = t->code(t->env);
+        t->done = true;
+    }
+    return t->value;
+}
+
+inline Thunk *delay(Value (*code)(Thunk **), Thunk **env)
+{
+    return new Thunk{code, env, false, {}};
+}
+
+inline Thunk *ready(Value value)
+{
+    return new Thunk{nullptr, nullptr, true, value};
+}
+
+inline Thunk **capture(std::initializer_list<Thunk *> thunks)
+{
+    auto res = new Thunk *[thunks.size()];
+    std::copy(thunks.begin(), thunks.end(), res);
+    return res;
+}
+
+inline Value closure(Value (*fn)(Thunk **, Thunk *), Thunk **env, std::uint32_t binder)
+{
+    return {fn, env, binder, nullptr};
+}
+
+inline Value neutral(std::uint32_t head)
+{
+    return {nullptr, nullptr, head, nullptr};
+}
+
+Thunk *atom(std::uint32_t symbol)
+{
+    static std::vector<Thunk *> atoms(symbol_count, nullptr);
+    if (!atoms[symbol])
+        atoms[symbol] = ready(neutral(symbol));
+    return atoms[symbol];
+}
+
+inline Value apply(Value f, Thunk *arg)
+{
+    if (f.fn)
+        return f.fn(f.env, arg);
+    return {nullptr, nullptr, f.head, new Spine{arg, f.args}};
+}
+
+char next_letter(char c)
+{
+    int i = static_cast<int>(c - 'a');
+    if (i > 26)
+        return c;
+    return static_cast<char>((i + 1) % 26) + 'a';
+}
+
+std::string fresh(const std::string &hint, const std::vector<std::string> &names)
+{
+    auto used = [&](const std::string &name)
+    {
+        for (auto &&n : names)
+        {
+            if (n == name)
+                return true;
+        }
+        for (std::size_t i = 0; i < symbol_count; i++)
+        {
+            if (introduced[i] && introduced[i] <= line && name == symbols[i])
+                return true;
+        }
+        return false;
+    };
+    auto res = hint;
+    while (used(res))
+    {
+        char c = next_letter(res.at(0));
+        if (c == hint.at(0))
+            res += "'";
+        res.at(0) = c;
+    }
+    return res;
+}
+
+std::string show(Value value, std::vector<std::string> &names)
+{
+    if (value.fn)
+    {
+        auto level = static_cast<std::uint32_t>(names.size());
+        names.push_back(fresh(symbols[value.head], names));
+        auto body = show(value.fn(value.env, ready(neutral(level_bit | level))), names);
+        auto res = "(λ" + names.back() + "." + body + ")";
+        names.pop_back();
+        return res;
+    }
+    std::vector<Thunk *> args;
+    for (auto s = value.args; s; s = s->next)
+    {
+        args.push_back(s->arg);
+    }
+    std::string res = (value.head & level_bit) ? names.at(value.head & ~level_bit) : symbols[value.head];
+    for (std::size_t i = args.size(); i > 0; i--)
+    {
+        res = "(" + res + " " + show(force(args[i - 1]), names) + ")";
+    }
+    return res;
+}
+
+std::string show(Value value)
+{
+    std::vector<std::string> names;
+    return show(value, names);
+}
+)runtime";
+
+    class Generator
+    {
+    public:
+        // reads the script line by line as main does and writes the program to os
+        void translate(std::istream &script, std::ostream &os);
+
+    private:
+        // what generated code can refer to: the argument x of the enclosing
+        // abstraction, if any, and the captured thunks c[0], c[1], ...
+        struct Frame
+        {
+            bool has_param;
+            std::string param;
+            std::vector<std::string> captured;
+        };
+
+        // the first definition of a name, which is the one Environment keeps
+        struct Source
+        {
+            std::size_t line;
+            Expression exp;
+        };
+
+        // code is compiled as reduced on line, inside the definition of owner,
+        // or of no definition for ""
+        struct Stage
+        {
+            std::size_t line;
+            std::string owner;
+        };
+
+        // unresolved: names that were left free because their definitions come
+        // later, including those of the globals it refers to
+        struct Global
+        {
+            std::size_t index;
+            std::set<std::string> unresolved;
+        };
+
+        std::vector<std::string> symbols;
+        std::map<std::string, std::size_t> symbol_ids;
+        std::map<std::size_t, std::size_t> constants;
+        std::size_t line = 0;
+        std::map<std::string, Source> definitions;
+        std::map<std::string, Global> globals;         // by the stages they were compiled in
+        std::vector<Stage> stages;                     // of the code being compiled, innermost last
+        std::vector<std::set<std::string>> unresolved; // of the globals being compiled, innermost last
+        std::ostringstream functions;
+        std::size_t count = 0;
+
+        std::size_t intern(const std::string &name);
+        std::size_t global(const std::string &name, std::size_t stage);
+        bool bound(const std::string &name, const Frame &frame) const;
+        std::string reference(const std::string &name, bool is_constant, const Frame &frame);
+        std::string capture(const Expression &exp, const Frame &frame, std::vector<std::string> &captured);
+        std::string value(const Expression &exp, const Frame &frame);
+        std::string thunk(const Expression &exp, const Frame &frame);
+    };
+
+    std::string quote(std::string_view str)
+    {
+        std::string res = "\"";
+        for (auto &&c : str)
+        {
+            if (c == '"' || c == '\\')
+                res += '\\';
+            res += c;
+        }
+        return res + "\"";
+    }
+
+    std::size_t Generator::intern(const std::string &name)
+    {
+        auto it = symbol_ids.find(name);
+        if (it != symbol_ids.end())
+            return it->second;
+        symbols.push_back(name);
+        symbol_ids.emplace(name, symbols.size() - 1);
+        return symbols.size() - 1;
+    }
+
+    bool Generator::bound(const std::string &name, const Frame &frame) const
+    {
+        if (frame.has_param && frame.param == name)
+            return true;
+        for (auto &&c : frame.captured)
+        {
+            if (c == name)
+                return true;
+        }
+        return false;
+    }
+
+    // a Thunk * for name
+    std::string Generator::reference(const std::string &name, bool is_constant, const Frame &frame)
+    {
+        if (!is_constant && frame.has_param && frame.param == name)
+            return "x";
+        for (std::size_t i = 0; i < frame.captured.size() && !is_constant; i++)
+        {
+            if (frame.captured.at(i) == name)
+                return "c[" + std::to_string(i) + "]";
+        }
+        // a name left free on the line of a definition is looked up again where
+        // the definition is used, innermost first
+        auto def = definitions.find(name);
+        if (def != definitions.end())
+        {
+            for (std::size_t s = stages.size(); s > 0; s--)
+            {
+                if (def->second.line < stages.at(s - 1).line && stages.at(s - 1).owner < name)
+                    return "global_" + std::to_string(global(name, s - 1)) + "()";
+            }
+            if (!unresolved.empty() && stages.front().owner < name)
+                unresolved.back().insert(name);
+        }
+        auto id = intern(name);
+        constants.emplace(id, line);
+        return "atom(" + std::to_string(id) + ")";
+    }
+
+    // index of the global for name resolved at stages[stage], compiled again
+    // when a name it left free has been defined since
+    std::size_t Generator::global(const std::string &name, std::size_t stage)
+    {
+        std::vector<Stage> inner(stages.begin(), stages.begin() + stage);
+        inner.push_back({stages.at(stage).line, name});
+        inner.push_back({definitions.at(name).line, ""});
+        // the outermost line only matters through unresolved
+        std::string key = "";
+        for (std::size_t i = 0; i < inner.size(); i++)
+        {
+            key += (i ? std::to_string(inner.at(i).line) : "") + " " + inner.at(i).owner + ";";
+        }
+
+        auto it = globals.find(key);
+        bool stale = false;
+        if (it != globals.end())
+        {
+            for (auto &&u : it->second.unresolved)
+            {
+                stale = stale || definitions.at(u).line < stages.front().line;
+            }
+        }
+        if (it == globals.end() || stale)
+        {
+            std::swap(stages, inner);
+            unresolved.emplace_back();
+            Frame top{false, "", {}};
+            auto body = value(definitions.at(name).exp, top);
+            std::swap(stages, inner);
+            auto names = std::move(unresolved.back());
+            unresolved.pop_back();
+
+            auto index = count++;
+            functions << "// " << name << "\n"
+                      << "Value define_" << index << "(Thunk **)\n{\n    return " << body << ";\n}\n\n"
+                      << "Thunk *global_" << index << "()\n{\n    static Thunk *t = delay(define_" << index << ", nullptr);\n    return t;\n}\n\n";
+            it = globals.insert_or_assign(key, Global{index, std::move(names)}).first;
+        }
+        if (!unresolved.empty())
+            unresolved.back().insert(it->second.unresolved.begin(), it->second.unresolved.end());
+        return it->second.index;
+    }
+
+    // the variables of the enclosing frame that exp refers to, and the code capturing them
+    std::string Generator::capture(const Expression &exp, const Frame &frame, std::vector<std::string> &captured)
+    {
+        for (auto &&name : exp.free_variables())
+        {
+            if (bound(name, frame))
+                captured.push_back(name);
+        }
+        if (captured.empty())
+            return "nullptr";
+        std::string res = "capture({";
+        for (std::size_t i = 0; i < captured.size(); i++)
+        {
+            res += (i ? ", " : "") + reference(captured.at(i), false, frame);
+        }
+        return res + "})";
+    }
+
+    // C++ expression evaluating exp to weak head normal form
+    std::string Generator::value(const Expression &exp, const Frame &frame)
+    {
+        switch (exp.kind())
+        {
+        case Expression::Kind::variable:
+        case Expression::Kind::constant:
+        {
+            auto ref = reference(exp.symbol(), exp.kind() == Expression::Kind::constant, frame);
+            if (ref.starts_with("atom("))
+                return "neutral(" + std::to_string(intern(exp.symbol())) + ")";
+            return "force(" + ref + ")";
+        }
+        case Expression::Kind::abstraction:
+        {
+            Frame inner{true, exp.symbol(), {}};
+            auto env = capture(exp, frame, inner.captured);
+            auto body = value(exp.body(), inner);
+            auto name = "lambda_" + std::to_string(count++);
+            // parameters the body does not use are left unnamed
+            functions << "// λ" << exp.symbol() << "\n"
+                      << "Value " << name << "(Thunk **" << (inner.captured.empty() ? "" : "c") << ", Thunk *"
+                      << (exp.body().free_variables().contains(exp.symbol()) ? "x" : "") << ")\n{\n    return " << body << ";\n}\n\n";
+            return "closure(" + name + ", " + env + ", " + std::to_string(intern(exp.symbol())) + ")";
+        }
+        default:
+        {
+            std::vector<const Expression *> args;
+            const Expression *head = &exp;
+            while (head->kind() == Expression::Kind::application)
+            {
+                args.push_back(&head->argument());
+                head = &head->function();
+            }
+            auto res = value(*head, frame);
+            for (std::size_t i = args.size(); i > 0; i--)
+            {
+                res = "apply(" + res + ", " + thunk(*args.at(i - 1), frame) + ")";
+            }
+            return res;
+        }
+        }
+    }
+
+    // C++ expression suspending exp
+    std::string Generator::thunk(const Expression &exp, const Frame &frame)
+    {
+        switch (exp.kind())
+        {
+        case Expression::Kind::variable:
+        case Expression::Kind::constant:
+            return reference(exp.symbol(), exp.kind() == Expression::Kind::constant, frame);
+        case Expression::Kind::abstraction:
+            return "ready(" + value(exp, frame) + ")";
+        default:
+        {
+            Frame inner{false, "", {}};
+            auto env = capture(exp, frame, inner.captured);
+            auto body = value(exp, inner);
+            auto name = "thunk_" + std::to_string(count++);
+            functions << "Value " << name << "(Thunk **" << (inner.captured.empty() ? "" : "c") << ")\n{\n    return " << body << ";\n}\n\n";
+            return "delay(" + name + ", " + env + ")";
+        }
+        }
+    }
+
+    void Generator::translate(std::istream &script, std::ostream &os)
+    {
+        // every definition is read first, so lines can use names defined after them
+        std::vector<std::string> lines;
+        std::map<std::size_t, std::pair<Definition, Expression>> parsed;
+        std::string str = "";
+        while (1)
+        {
+            std::getline(script, str);
+            lines.push_back(str);
+            if (str.size() > 0 && str.at(0) != '#')
+            {
+                auto res = reduce(lexer(str));
+                if (res.first.name != "")
+                    definitions.emplace(res.first.name, Source{lines.size(), res.first.exp});
+                parsed.emplace(lines.size(), std::move(res));
+            }
+            if (script.bad() || script.eof())
+                break;
+        }
+
+        std::ostringstream statements;
+        for (line = 1; line <= lines.size(); line++)
+        {
+            auto &str = lines.at(line - 1);
+            auto prefix = "line " + std::to_string(line) + ": ";
+            if (str.size() > 0 && str.at(0) == '#')
+            {
+                statements << "    std::cout << " << quote(prefix + str) << " << \"\\n\";\n";
+            }
+            else if (str.size() > 0)
+            {
+                statements << "    line = " << line << ";\n";
+                // a definition is reduced here as an expression; later lines use its global
+                auto &res = parsed.at(line);
+                Frame top{false, "", {}};
+                stages = {{line, ""}};
+                auto body = value(res.first.name != "" ? res.first.exp : res.second, top);
+                auto index = count++;
+                functions << "Value line_" << index << "()\n{\n    return " << body << ";\n}\n\n";
+                auto shown = prefix + (res.first.name != "" ? res.first.name + " := " : "");
+                statements << "    std::cout << " << quote(shown) << " << show(line_" << index << "()) << std::endl;\n";
+            }
+        }
+
+        os << runtime << "\n";
+        os << "std::size_t symbol_count = " << symbols.size() << ";\n";
+        os << "const char *symbols[] = {";
+        for (std::size_t i = 0; i < symbols.size(); i++)
+        {
+            os << (i ? ", " : "") << quote(symbols.at(i));
+        }
+        os << (symbols.empty() ? "\"\"" : "") << "};\n";
+        os << "std::size_t introduced[] = {";
+        for (std::size_t i = 0; i < symbols.size(); i++)
+        {
+            os << (i ? ", " : "") << (constants.contains(i) ? constants.at(i) : 0);
+        }
+        os << (symbols.empty() ? "0" : "") << "};\n\n";
+        os << functions.str();
+        os << "int main()\n{\n" << statements.str() << "    return 0;\n}\n";
+    }
+}
+
+#endif
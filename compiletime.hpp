@@ -0,0 +1,410 @@
+#ifndef INCLUDED_COMPILETIME_HPP
+#define INCLUDED_COMPILETIME_HPP
+
+#include "lambda.hpp"
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Compile-time parsing and normalization of term literals.
+//
+//     using K = ct::normal<"(\\x.\\y.x) a">;
+//     Expression e = K::expression();
+//
+// The literal follows the syntax accepted by lexer (definitions excluded);
+// characters lexer skips over, other than whitespace, are errors. Terms are
+// kept as de Bruijn indexed node tables; errors and exceeded bounds are
+// reported as compile errors.
+namespace ct
+{
+    template <std::size_t N>
+    struct literal
+    {
+        char str[N]{};
+
+        constexpr literal(const char (&s)[N])
+        {
+            for (std::size_t i = 0; i < N; i++)
+                str[i] = s[i];
+        }
+
+        constexpr std::size_t size() const
+        {
+            return N - 1;
+        }
+    };
+
+    enum class Tag : std::uint32_t
+    {
+        bound,       // lhs: de Bruijn index
+        free,        // lhs: offset of the name in the literal, rhs: length
+        abstraction, // lhs: body, rhs: binder letter
+        application  // lhs: function, rhs: argument
+    };
+
+    struct Node
+    {
+        Tag tag;
+        std::uint32_t lhs;
+        std::uint32_t rhs;
+    };
+
+    template <std::size_t Capacity>
+    struct Table
+    {
+        Node nodes[Capacity]{};
+        std::uint32_t size = 0;
+        std::uint32_t root = 0;
+        std::size_t steps = 0;
+
+        constexpr std::uint32_t make(Tag tag, std::uint32_t lhs, std::uint32_t rhs)
+        {
+            if (size == Capacity)
+                throw "ct: node capacity exceeded";
+            nodes[size] = {tag, lhs, rhs};
+            return size++;
+        }
+    };
+
+    constexpr bool is_ident(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9');
+    }
+
+    template <std::size_t Capacity, std::size_t N>
+    class Parser
+    {
+    public:
+        constexpr Parser(const literal<N> &src) : src(src) {}
+
+        constexpr Table<Capacity> parse()
+        {
+            res.root = sequence();
+            if (pos != src.size())
+                throw "ct: unbalanced parenthesis";
+            return res;
+        }
+
+    private:
+        const literal<N> &src;
+        Table<Capacity> res;
+        std::size_t pos = 0;
+        char binders[256]{};
+        std::size_t depth = 0;
+
+        // to the next token
+        constexpr void skip()
+        {
+            while (pos < src.size())
+            {
+                char c = src.str[pos];
+                if (is_ident(c) || c == '(' || c == ')' || c == '\\' || c == '.')
+                    return;
+                if (c == '=')
+                    throw "ct: definitions are not terms";
+                if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+                    throw "ct: unexpected character";
+                pos++;
+            }
+        }
+
+        constexpr std::uint32_t sequence()
+        {
+            bool empty = true;
+            std::uint32_t exp = 0;
+            while (1)
+            {
+                skip();
+                if (pos == src.size() || src.str[pos] == ')')
+                    break;
+                auto arg = atom();
+                exp = empty ? arg : res.make(Tag::application, exp, arg);
+                empty = false;
+            }
+            if (empty)
+                throw "ct: empty term";
+            return exp;
+        }
+
+        constexpr std::uint32_t atom()
+        {
+            char c = src.str[pos];
+            if (c == '(')
+            {
+                pos++;
+                auto exp = sequence();
+                if (pos == src.size())
+                    throw "ct: unbalanced parenthesis";
+                pos++;
+                return exp;
+            }
+            if (c == '\\')
+            {
+                pos++;
+                auto outer = depth;
+                while (1)
+                {
+                    skip();
+                    if (pos == src.size())
+                        throw "ct: abstraction without body";
+                    c = src.str[pos++];
+                    if (c == '.')
+                        break;
+                    if (!is_ident(c) || depth == sizeof(binders))
+                        throw "ct: bad binder";
+                    binders[depth++] = c;
+                }
+                auto exp = sequence();
+                while (depth > outer)
+                {
+                    exp = res.make(Tag::abstraction, exp, static_cast<std::uint32_t>(binders[--depth]));
+                }
+                return exp;
+            }
+            if (c == '.')
+                throw "ct: unexpected '.'";
+
+            auto begin = pos;
+            while (pos < src.size() && is_ident(src.str[pos]))
+                pos++;
+            if (pos - begin == 1 && c >= 'a' && c <= 'z')
+            {
+                for (std::size_t i = depth; i > 0; i--)
+                {
+                    if (binders[i - 1] == c)
+                        return res.make(Tag::bound, static_cast<std::uint32_t>(depth - i), 0);
+                }
+            }
+            return res.make(Tag::free, static_cast<std::uint32_t>(begin), static_cast<std::uint32_t>(pos - begin));
+        }
+    };
+
+    template <std::size_t Capacity>
+    class Normalizer
+    {
+    public:
+        constexpr Normalizer(Table<Capacity> &t, std::size_t bound) : t(t), bound(bound) {}
+
+        constexpr std::uint32_t shift(std::uint32_t exp, std::uint32_t d, std::uint32_t cutoff)
+        {
+            auto n = t.nodes[exp];
+            switch (n.tag)
+            {
+            case Tag::bound:
+                return (n.lhs >= cutoff) ? t.make(Tag::bound, n.lhs + d, 0) : exp;
+            case Tag::abstraction:
+                return t.make(Tag::abstraction, shift(n.lhs, d, cutoff + 1), n.rhs);
+            case Tag::application:
+                return t.make(Tag::application, shift(n.lhs, d, cutoff), shift(n.rhs, d, cutoff));
+            default:
+                return exp;
+            }
+        }
+
+        // exp[depth := arg], removing the binder of depth
+        constexpr std::uint32_t substitute(std::uint32_t exp, std::uint32_t depth, std::uint32_t arg)
+        {
+            auto n = t.nodes[exp];
+            switch (n.tag)
+            {
+            case Tag::bound:
+                if (n.lhs == depth)
+                    return depth == 0 ? arg : shift(arg, depth, 0);
+                return (n.lhs > depth) ? t.make(Tag::bound, n.lhs - 1, 0) : exp;
+            case Tag::abstraction:
+                return t.make(Tag::abstraction, substitute(n.lhs, depth + 1, arg), n.rhs);
+            case Tag::application:
+                return t.make(Tag::application, substitute(n.lhs, depth, arg), substitute(n.rhs, depth, arg));
+            default:
+                return exp;
+            }
+        }
+
+        constexpr std::uint32_t whnf(std::uint32_t exp)
+        {
+            while (t.nodes[exp].tag == Tag::application)
+            {
+                auto n = t.nodes[exp];
+                auto f = whnf(n.lhs);
+                if (t.nodes[f].tag != Tag::abstraction)
+                    return (f == n.lhs) ? exp : t.make(Tag::application, f, n.rhs);
+                if (++t.steps > bound)
+                    throw "ct: step bound exceeded";
+                exp = substitute(t.nodes[f].lhs, 0, n.rhs);
+            }
+            return exp;
+        }
+
+        constexpr std::uint32_t normalize(std::uint32_t exp)
+        {
+            exp = whnf(exp);
+            auto n = t.nodes[exp];
+            if (n.tag == Tag::abstraction)
+            {
+                auto body = normalize(n.lhs);
+                return (body == n.lhs) ? exp : t.make(Tag::abstraction, body, n.rhs);
+            }
+            if (n.tag == Tag::application)
+            {
+                auto f = normalize(n.lhs);
+                auto a = normalize(n.rhs);
+                return (f == n.lhs && a == n.rhs) ? exp : t.make(Tag::application, f, a);
+            }
+            return exp;
+        }
+
+    private:
+        Table<Capacity> &t;
+        std::size_t bound;
+    };
+
+    template <std::size_t Capacity>
+    constexpr std::uint32_t reachable(const Table<Capacity> &t, std::uint32_t exp)
+    {
+        auto n = t.nodes[exp];
+        switch (n.tag)
+        {
+        case Tag::abstraction:
+            return 1 + reachable(t, n.lhs);
+        case Tag::application:
+            return 1 + reachable(t, n.lhs) + reachable(t, n.rhs);
+        default:
+            return 1;
+        }
+    }
+
+    template <std::size_t Size, std::size_t Capacity>
+    constexpr std::uint32_t copy(Table<Size> &dst, const Table<Capacity> &src, std::uint32_t exp)
+    {
+        auto n = src.nodes[exp];
+        switch (n.tag)
+        {
+        case Tag::abstraction:
+            return dst.make(n.tag, copy(dst, src, n.lhs), n.rhs);
+        case Tag::application:
+        {
+            auto f = copy(dst, src, n.lhs);
+            return dst.make(n.tag, f, copy(dst, src, n.rhs));
+        }
+        default:
+            return dst.make(n.tag, n.lhs, n.rhs);
+        }
+    }
+
+    // keeps only the nodes reachable from the root
+    template <std::size_t Size, std::size_t Capacity>
+    constexpr Table<Size> compact(const Table<Capacity> &src)
+    {
+        Table<Size> dst;
+        dst.root = copy(dst, src, src.root);
+        dst.steps = src.steps;
+        return dst;
+    }
+
+    template <std::size_t N, std::size_t Size>
+    Expression build(const literal<N> &src, const Table<Size> &t, std::uint32_t exp, std::vector<std::string> &names)
+    {
+        auto n = t.nodes[exp];
+        switch (n.tag)
+        {
+        case Tag::bound:
+            return Expression(names.at(names.size() - 1 - n.lhs));
+        case Tag::free:
+        {
+            std::string name(src.str + n.lhs, n.rhs);
+            return Expression(name, name.size() > 1 || !std::islower(name.at(0)));
+        }
+        case Tag::abstraction:
+        {
+            // binders never shadow, so normalized tables print without capture
+            std::string name = {static_cast<char>(n.rhs)};
+            auto used = [&](const std::string &x)
+            {
+                for (auto &&e : names)
+                {
+                    if (e == x)
+                        return true;
+                }
+                for (std::uint32_t i = 0; i < t.size; i++)
+                {
+                    if (t.nodes[i].tag == Tag::free && std::string(src.str + t.nodes[i].lhs, t.nodes[i].rhs) == x)
+                        return true;
+                }
+                return false;
+            };
+            for (int i = 0; i < 26 && used(name); i++)
+            {
+                name.at(0) = impl::next_letter(name.at(0));
+            }
+            while (used(name))
+            {
+                name += "'";
+            }
+            names.push_back(name);
+            auto body = build(src, t, n.lhs, names);
+            names.pop_back();
+            return Expression(name, body);
+        }
+        default:
+        {
+            auto f = build(src, t, n.lhs, names);
+            return Expression(f, build(src, t, n.rhs, names));
+        }
+        }
+    }
+
+    template <literal S, std::size_t Capacity = 1024>
+    constexpr Table<Capacity> parse()
+    {
+        return Parser<Capacity, sizeof(S.str)>(S).parse();
+    }
+
+    template <literal S, std::size_t Steps, std::size_t Capacity>
+    constexpr Table<Capacity> reduce()
+    {
+        auto t = parse<S, Capacity>();
+        t.root = Normalizer<Capacity>(t, Steps).normalize(t.root);
+        return t;
+    }
+
+    // a parsed term literal
+    template <literal S, std::size_t Capacity = 1024>
+    struct term
+    {
+        static constexpr auto source = S;
+        static constexpr std::uint32_t size = reachable(parse<S, Capacity>(), parse<S, Capacity>().root);
+        static constexpr Table<size> table = compact<size>(parse<S, Capacity>());
+
+        static Expression expression()
+        {
+            static const Expression exp = [] {
+                std::vector<std::string> names;
+                return build(source, table, table.root, names);
+            }();
+            return exp;
+        }
+    };
+
+    // a term literal in normal form, reached in at most Steps beta steps
+    template <literal S, std::size_t Steps = 1000, std::size_t Capacity = 4096>
+    struct normal
+    {
+        static constexpr auto source = S;
+        static constexpr auto reduced = reduce<S, Steps, Capacity>();
+        static constexpr std::uint32_t size = reachable(reduced, reduced.root);
+        static constexpr Table<size> table = compact<size>(reduced);
+
+        static Expression expression()
+        {
+            static const Expression exp = [] {
+                std::vector<std::string> names;
+                return build(source, table, table.root, names);
+            }();
+            return exp;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef INCLUDED_CONTROL_HPP
+#define INCLUDED_CONTROL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+
+// Cooperative cancellation and progress of an evaluation.
+// The evaluating thread points active at a Progress that another thread (or a
+// signal handler) may read and cancel; every reduction step checks it.
+namespace control
+{
+    class Interrupted : public std::exception
+    {
+    public:
+        virtual const char *what() const noexcept
+        {
+            return "interrupted";
+        }
+    };
+
+    struct Progress
+    {
+        std::atomic<bool> cancel{false};
+        std::atomic<std::size_t> steps{0};
+
+        void restart()
+        {
+            cancel.store(false);
+            steps.store(0);
+        }
+    };
+
+    thread_local Progress *active = nullptr;
+
+    // tree nodes alive in the process
+    std::atomic<std::size_t> nodes{0};
+
+    // counts one reduction step, throws Interrupted once cancellation was requested
+    void step()
+    {
+        if (!active)
+            return;
+        active->steps.store(active->steps.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (active->cancel.load(std::memory_order_relaxed))
+            throw Interrupted();
+    }
+}
+
+#endif
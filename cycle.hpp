@@ -0,0 +1,141 @@
+#ifndef INCLUDED_CYCLE_HPP
+#define INCLUDED_CYCLE_HPP
+
+#include "lambda.hpp"
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace impl
+{
+    std::size_t combine(std::size_t seed, std::size_t h)
+    {
+        return seed ^ (h + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+    }
+
+    std::size_t canonical_hash(const Expression &exp, std::vector<std::string> &scope)
+    {
+        switch (exp.kind())
+        {
+        case Expression::Kind::variable:
+            for (std::size_t i = scope.size(); i > 0; i--)
+            {
+                if (scope.at(i - 1) == exp.symbol())
+                    return combine(1, scope.size() - i);
+            }
+            return combine(2, std::hash<std::string>()(exp.symbol()));
+        case Expression::Kind::constant:
+            return combine(2, std::hash<std::string>()(exp.symbol()));
+        case Expression::Kind::abstraction:
+        {
+            scope.push_back(exp.symbol());
+            auto res = combine(3, canonical_hash(exp.body(), scope));
+            scope.pop_back();
+            return res;
+        }
+        default:
+            return combine(combine(4, canonical_hash(exp.function(), scope)), canonical_hash(exp.argument(), scope));
+        }
+    }
+
+    bool alpha_equivalent(const Expression &a, const Expression &b, std::vector<std::string> &sa, std::vector<std::string> &sb)
+    {
+        auto named = [](Expression::Kind k)
+        {
+            return k == Expression::Kind::variable || k == Expression::Kind::constant;
+        };
+        if (named(a.kind()) && named(b.kind()))
+        {
+            std::size_t ia = 0, ib = 0;
+            for (std::size_t i = sa.size(); i > 0 && ia == 0; i--)
+            {
+                if (a.kind() == Expression::Kind::variable && sa.at(i - 1) == a.symbol())
+                    ia = i;
+            }
+            for (std::size_t i = sb.size(); i > 0 && ib == 0; i--)
+            {
+                if (b.kind() == Expression::Kind::variable && sb.at(i - 1) == b.symbol())
+                    ib = i;
+            }
+            if (ia != 0 || ib != 0)
+                return ia == ib;
+            return a.symbol() == b.symbol();
+        }
+        if (a.kind() != b.kind())
+            return false;
+        if (a.kind() == Expression::Kind::abstraction)
+        {
+            sa.push_back(a.symbol());
+            sb.push_back(b.symbol());
+            bool res = alpha_equivalent(a.body(), b.body(), sa, sb);
+            sa.pop_back();
+            sb.pop_back();
+            return res;
+        }
+        return alpha_equivalent(a.function(), b.function(), sa, sb) && alpha_equivalent(a.argument(), b.argument(), sa, sb);
+    }
+}
+
+// hash that agrees on alpha-equivalent terms
+std::size_t canonical_hash(const Expression &exp)
+{
+    std::vector<std::string> scope;
+    return impl::canonical_hash(exp, scope);
+}
+
+bool alpha_equivalent(const Expression &a, const Expression &b)
+{
+    std::vector<std::string> sa, sb;
+    return impl::alpha_equivalent(a, b, sa, sb);
+}
+
+bool has_redex(const Expression &exp)
+{
+    return !exp.is_normal();
+}
+
+class DivergenceException : public std::exception
+{
+public:
+    DivergenceException(std::size_t period) : message("diverges: the term repeats every " + std::to_string(period) + " step(s)") {}
+
+    virtual const char *what() const noexcept
+    {
+        return message.c_str();
+    }
+
+private:
+    std::string message;
+};
+
+// Brent's algorithm over the states of one reduction sequence.
+// Only the last checkpoint is kept, so memory stays bounded by one term.
+class CycleDetector
+{
+public:
+    // throws DivergenceException once exp is alpha-equivalent to an earlier state
+    void observe(const Expression &exp)
+    {
+        auto hash = canonical_hash(exp);
+        lambda++;
+        if (hash == saved_hash && alpha_equivalent(exp, saved))
+            throw DivergenceException(lambda);
+        if (lambda == power)
+        {
+            saved = exp;
+            saved_hash = hash;
+            power *= 2;
+            lambda = 0;
+        }
+    }
+
+private:
+    Expression saved = Constant("");
+    std::size_t saved_hash = 0;
+    std::size_t power = 1;
+    std::size_t lambda = 0;
+};
+
+#endif
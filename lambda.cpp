@@ -1,14 +1,112 @@
+#include "codegen.hpp"
+#include "control.hpp"
 #include "lambda.hpp"
+#include "pool.hpp"
+#include "profile.hpp"
 #include "reducer.hpp"
+#include "simplify.hpp"
+#include "ski.hpp"
+#include "strategy.hpp"
+#include "types.hpp"
+#include "vm.hpp"
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
 #include <fstream>
+#include <future>
 #include <iostream>
+#include <string>
 #include <variant>
 
-std::variant<Expression, Definition> parseandreduce(std::string_view str, Environment &env)
+enum class Backend
+{
+    tree,
+    vm,
+    pool,
+    ski
+};
+
+struct Session
+{
+    Backend backend = Backend::tree;
+    Strategy strategy = Strategy::parallel;
+    bool detect_cycles = false;
+    bool infer = false;
+    simplify::Options simplification;
+    simplify::Stats simplified;
+    bool profiling = false;
+    std::string folded = "";
+    profile::Profiler profiler;
+    vm::Machine machine;
+    pool::Pool pool;
+    ski::Graph graph;
+    types::Checker checker;
+    control::Progress progress;
+};
+
+// the evaluation Ctrl-C cancels, null while the REPL waits for input
+std::atomic<control::Progress *> running{nullptr};
+
+void interrupt(int)
+{
+    auto progress = running.load();
+    if (!progress)
+        std::_Exit(130);
+    progress->cancel.store(true);
+}
+
+Expression normalize(const Expression &exp, const Environment &env, Session &session)
+{
+    // the machine, the pool and the graph only produce full normal forms
+    bool full = (session.strategy != Strategy::whnf && session.strategy != Strategy::hnf);
+    if (session.backend == Backend::vm && full)
+        return session.machine.normalize(exp, env);
+    if (session.backend == Backend::pool && full)
+        return session.pool.normalize(exp, env);
+    if (session.backend == Backend::ski && full)
+        return session.graph.normalize(exp, env);
+    // simply typed terms are strongly normalizing: any order terminates, so they skip cycle checks
+    if (session.infer && full && session.checker.typeable(exp, env))
+        return evaluate(exp, env, Strategy::applicative);
+    return evaluate(exp, env, session.strategy, session.detect_cycles);
+}
+
+// "#pragma strategy <name>", "#pragma detect-cycles on|off", "#pragma infer on|off" and
+// "#pragma simplify on|off|<passes>" change the session for the following lines,
+// any other line starting with '#' is a comment
+void pragma(std::string_view str, Session &session)
+{
+    std::string_view strategy = "#pragma strategy ", cycles = "#pragma detect-cycles ", infer = "#pragma infer ", simplification = "#pragma simplify ";
+    if (str.starts_with(strategy))
+    {
+        if (!parse_strategy(str.substr(strategy.size()), session.strategy))
+            std::cout << "unknown strategy: " << str.substr(strategy.size()) << std::endl;
+    }
+    else if (str.starts_with(cycles))
+    {
+        session.detect_cycles = (str.substr(cycles.size()) == "on");
+    }
+    else if (str.starts_with(infer))
+    {
+        session.infer = (str.substr(infer.size()) == "on");
+    }
+    else if (str.starts_with(simplification))
+    {
+        if (!simplify::parse_passes(str.substr(simplification.size()), session.simplification))
+            std::cout << "unknown simplification: " << str.substr(simplification.size()) << std::endl;
+    }
+}
+
+std::variant<Expression, Definition> parseandreduce(std::string_view str, Environment &env, Session &session)
 {
     auto res = reduce(lexer(str));
     auto l = res.second;
     bool is_def = (res.first.name != "");
+    if (is_def)
+        res.first.exp = simplify::run(res.first.exp, env, session.simplification, session.simplified);
+    else
+        l = simplify::run(l, env, session.simplification, session.simplified);
 
     if (debugprint)
     {
@@ -23,50 +121,157 @@ std::variant<Expression, Definition> parseandreduce(std::string_view str, Enviro
         std::cout << std::endl;
     }
 
-    for (auto &&def : env)
+    if (is_def)
     {
-        l = l.substitute(def.name, def.exp);
+        auto exp = normalize(res.first.exp, env, session);
+        // origins only matter to the profiler
+        Definition def{res.first.name, session.profiling ? Tagged(exp, res.first.name) : exp};
+        env.insert(def);
+        return def;
     }
+    return normalize(l, env, session);
+}
+
+// evaluates a REPL line on a worker thread, showing steps and live nodes on stderr while it runs
+std::variant<Expression, Definition> evaluate_async(const std::string &str, Environment &env, Session &session)
+{
+    session.progress.restart();
+    // set before the job starts so Ctrl-C never finds it empty mid-evaluation
+    running.store(&session.progress);
+    struct Finished
+    {
+        ~Finished()
+        {
+            running.store(nullptr);
+        }
+    } finished;
+    auto job = std::async(std::launch::async, [&]
+                          {
+                              control::active = &session.progress;
+                              if (session.profiling)
+                                  profile::active = &session.profiler;
+                              return parseandreduce(str, env, session); });
 
-    auto tmp = l.beta_reduction();
-    while (l.str() != tmp.str())
+    bool shown = false;
+    while (job.wait_for(std::chrono::milliseconds(200)) != std::future_status::ready)
     {
-        l = tmp;
-        tmp = tmp.beta_reduction();
+        std::cerr << "\r[" << session.progress.steps.load() << " steps, " << control::nodes.load() << " nodes]" << std::flush;
+        shown = true;
     }
-    l = tmp;
+    if (shown)
+        std::cerr << "\r\033[K" << std::flush;
+    return job.get();
+}
 
-    if (is_def)
+void report(Session &session)
+{
+    if (session.folded != "")
     {
-        auto entity = res.first.exp;
-        for (auto &&def : env)
-        {
-            entity = entity.substitute(def.name, def.exp);
-        }
-        auto tmp = entity.beta_reduction();
-        while (entity.str() != tmp.str())
-        {
-            entity = tmp;
-            tmp = tmp.beta_reduction();
-        }
-        entity = tmp;
-        Definition def{res.first.name, entity};
-        env.insert(def);
-        return def;
+        std::ofstream ofs(session.folded);
+        session.profiler.folded(ofs);
+        return;
     }
-    return l;
+    std::cout << "\n";
+    session.profiler.report(std::cout);
 }
 
 int main(int argc, char **argv)
 {
     Environment env = {};
+    Session session;
     std::string str = "";
-    if (argc == 2)
+    std::string file = "";
+    std::string emit = "";
+    for (int i = 1; i < argc; i++)
     {
-        std::ifstream ifs(argv[1]);
+        std::string_view arg = argv[i];
+        if (arg == "--backend=tree")
+        {
+            session.backend = Backend::tree;
+        }
+        else if (arg == "--backend=vm")
+        {
+            session.backend = Backend::vm;
+        }
+        else if (arg == "--backend=pool")
+        {
+            session.backend = Backend::pool;
+        }
+        else if (arg == "--backend=ski")
+        {
+            session.backend = Backend::ski;
+        }
+        else if (arg.starts_with("--strategy="))
+        {
+            if (!parse_strategy(arg.substr(11), session.strategy))
+            {
+                std::cout << "unknown strategy: " << arg.substr(11) << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--detect-cycles")
+        {
+            session.detect_cycles = true;
+        }
+        else if (arg == "--infer")
+        {
+            session.infer = true;
+        }
+        else if (arg == "--simplify")
+        {
+            simplify::parse_passes("on", session.simplification);
+        }
+        else if (arg.starts_with("--simplify="))
+        {
+            if (!simplify::parse_passes(arg.substr(11), session.simplification))
+            {
+                std::cout << "unknown simplification: " << arg.substr(11) << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--profile")
+        {
+            session.profiling = true;
+        }
+        else if (arg.starts_with("--profile-folded="))
+        {
+            session.profiling = true;
+            session.folded = arg.substr(17);
+        }
+        else if (arg.starts_with("--emit-cpp="))
+        {
+            emit = arg.substr(11);
+        }
+        else if (arg.starts_with("--"))
+        {
+            std::cout << "unknown option: " << arg << std::endl;
+            return 1;
+        }
+        else
+        {
+            file = arg;
+        }
+    }
+    if (session.profiling)
+        profile::active = &session.profiler;
+    if (emit != "")
+    {
+        std::ifstream ifs(file);
         if (!ifs)
         {
-            std::cout << "not found: " << argv[1] << std::endl;
+            std::cout << "not found: " << file << std::endl;
+            return 1;
+        }
+        std::ofstream ofs(emit);
+        codegen::Generator().translate(ifs, ofs);
+        return 0;
+    }
+    if (file != "")
+    {
+        std::ifstream ifs(file);
+        if (!ifs)
+        {
+            std::cout << "not found: " << file << std::endl;
             return 1;
         }
         else
@@ -79,27 +284,65 @@ int main(int argc, char **argv)
                 if (str.size() > 0 && str.at(0) == '#')
                 {
                     std::cout << str << "\n";
+                    pragma(str, session);
                 }
                 else
                 {
-                    std::visit([](const auto &x)
-                               { std::cout << x.str() << std::endl; },
-                               parseandreduce(str, env));
+                    try
+                    {
+                        std::visit([](const auto &x)
+                                   { std::cout << x.str() << std::endl; },
+                                   parseandreduce(str, env, session));
+                    }
+                    catch (const DivergenceException &e)
+                    {
+                        std::cout << e.what() << std::endl;
+                    }
                 }
                 if (ifs.bad() || ifs.eof())
                     break;
                 line++;
             }
+            if (session.simplified.total() > 0 || simplify::enabled(session.simplification))
+                session.simplified.report(std::cout);
+            if (session.profiling)
+                report(session);
             return 0;
         }
     }
+    std::signal(SIGINT, interrupt);
     while (1)
     {
         std::cout << "λ>";
-        std::getline(std::cin, str);
-        std::visit([](const auto &x)
-                   { std::cout << x.str() << std::endl; },
-                   parseandreduce(str, env));
+        if (!std::getline(std::cin, str))
+        {
+            std::cout << std::endl;
+            break;
+        }
+        if (str.size() > 0 && str.at(0) == '#')
+        {
+            pragma(str, session);
+            continue;
+        }
+        try
+        {
+            session.simplified = {};
+            std::visit([](const auto &x)
+                       { std::cout << x.str() << std::endl; },
+                       evaluate_async(str, env, session));
+            if (session.simplified.total() > 0)
+                session.simplified.report(std::cerr);
+        }
+        catch (const DivergenceException &e)
+        {
+            std::cout << e.what() << std::endl;
+        }
+        catch (const control::Interrupted &e)
+        {
+            std::cout << e.what() << std::endl;
+        }
     }
+    if (session.profiling)
+        report(session);
     return 0;
 }
\ No newline at end of file
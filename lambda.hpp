@@ -1,8 +1,12 @@
 #ifndef INCLUDED_LAMBDA_HPP
 #define INCLUDED_LAMBDA_HPP
 
+#include "control.hpp"
+#include "profile.hpp"
+#include <atomic>
 #include <memory>
 #include <set>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -48,6 +52,10 @@ namespace impl
     class Application;
     class Constant;
 
+    // Expressions are values over shared, immutable nodes: copies share structure
+    // and can be read from any number of threads. A node is only rewritten in
+    // place through an rvalue whose node has no other owner, which no other
+    // thread can reach.
     class Expression
     {
         friend class Variable;
@@ -58,7 +66,17 @@ namespace impl
     private:
         std::shared_ptr<Expression> rep;
 
-        virtual Expression beta_impl(const Expression &exp) const;
+        Expression(std::shared_ptr<Expression> &&rep);
+        bool unique() const;
+
+        virtual Expression beta_impl(const Expression &exp) const &;
+        Expression beta_impl(const Expression &exp) &&;
+
+        // in-place variants, called on a node whose only owner is self
+        virtual Expression beta_impl(const Expression &exp, std::shared_ptr<Expression> &&self);
+        virtual Expression avoid(const std::set<std::string> &v, std::shared_ptr<Expression> &&self);
+        virtual Expression substitute(std::string_view v, const Expression &exp, std::shared_ptr<Expression> &&self);
+        virtual Expression beta_reduction(std::shared_ptr<Expression> &&self);
 
     protected:
         Expression(BaseConstructor);
@@ -66,17 +84,53 @@ namespace impl
     public:
         Expression(std::string_view v, bool is_constant);
         Expression(std::string_view x, const Expression &exp);
+        Expression(std::string_view x, const Expression &exp, std::uint32_t origin);
         Expression(const Expression &exp1, const Expression &exp2);
 
+        Expression(const Expression &) = default;
+        Expression(Expression &&) = default;
+        Expression &operator=(const Expression &) = default;
+        Expression &operator=(Expression &&) = default;
+
         virtual ~Expression() {}
 
         virtual std::string str() const;
         virtual std::set<std::string> free_variables() const;
         virtual std::set<std::string> bound_variables() const;
 
-        virtual Expression avoid(const std::set<std::string> &v) const;
-        virtual Expression substitute(std::string_view v, const Expression &exp) const;
-        virtual Expression beta_reduction() const;
+        // true when the term has no redex, known from construction without a traversal
+        virtual bool is_normal() const;
+
+        // the rvalue overloads rewrite uniquely owned nodes in place instead of copying them
+        virtual Expression avoid(const std::set<std::string> &v) const &;
+        virtual Expression substitute(std::string_view v, const Expression &exp) const &;
+        virtual Expression beta_reduction() const &;
+        Expression avoid(const std::set<std::string> &v) &&;
+        Expression substitute(std::string_view v, const Expression &exp) &&;
+        Expression beta_reduction() &&;
+
+        enum class Kind
+        {
+            variable,
+            abstraction,
+            application,
+            constant
+        };
+
+        // read-only view of the node, used by backends that compile terms
+        virtual Kind kind() const;
+        const std::string &symbol() const;
+        const Expression &body() const;
+        const Expression &function() const;
+        const Expression &argument() const;
+        bool identical(const Expression &exp) const;
+
+        // chain of definitions an abstraction was inlined through, see profile.hpp
+        std::uint32_t origin() const;
+
+        // contracts (this exp) if this is an abstraction, otherwise builds the application
+        Expression apply(const Expression &exp) const &;
+        Expression apply(const Expression &exp) &&;
     };
 
     class Variable : public Expression, public Named
@@ -89,18 +143,29 @@ namespace impl
 
         Variable(std::string_view v);
 
-        virtual Expression beta_impl(const Expression &exp) const;
+        virtual Expression beta_impl(const Expression &exp) const &;
 
         virtual std::string str() const;
         virtual std::set<std::string> free_variables() const;
         virtual std::set<std::string> bound_variables() const;
+        virtual bool is_normal() const;
+
+        virtual Expression avoid(const std::set<std::string> &v) const &;
+        virtual Expression substitute(std::string_view v, const Expression &exp) const &;
+        virtual Expression beta_reduction() const &;
 
-        virtual Expression avoid(const std::set<std::string> &v) const;
-        virtual Expression substitute(std::string_view v, const Expression &exp) const;
-        virtual Expression beta_reduction() const;
+        virtual Expression beta_impl(const Expression &exp, std::shared_ptr<Expression> &&self);
+        virtual Expression avoid(const std::set<std::string> &v, std::shared_ptr<Expression> &&self);
+        virtual Expression substitute(std::string_view v, const Expression &exp, std::shared_ptr<Expression> &&self);
+        virtual Expression beta_reduction(std::shared_ptr<Expression> &&self);
+
+        virtual Kind kind() const;
 
     public:
-        virtual ~Variable() {}
+        virtual ~Variable()
+        {
+            control::nodes.fetch_sub(1, std::memory_order_relaxed);
+        }
     };
 
     class Abstraction : public Expression
@@ -111,24 +176,39 @@ namespace impl
         friend class Application;
         friend class Constant;
 
-        Variable arg;
+        Named arg;
         Expression exp;
+        std::uint32_t origin;
+        bool normal;
 
-        Abstraction(std::string_view x, const Expression &exp);
+        std::string fresh(const Expression &body, const std::set<std::string> &v) const;
+
+        Abstraction(std::string_view x, const Expression &exp, std::uint32_t origin = 0);
         Abstraction(const Variable &x, const Expression &exp);
 
-        virtual Expression beta_impl(const Expression &exp) const;
+        virtual Expression beta_impl(const Expression &exp) const &;
 
         virtual std::string str() const;
         virtual std::set<std::string> free_variables() const;
         virtual std::set<std::string> bound_variables() const;
+        virtual bool is_normal() const;
+
+        virtual Expression avoid(const std::set<std::string> &v) const &;
+        virtual Expression substitute(std::string_view v, const Expression &exp) const &;
+        virtual Expression beta_reduction() const &;
+
+        virtual Expression beta_impl(const Expression &exp, std::shared_ptr<Expression> &&self);
+        virtual Expression avoid(const std::set<std::string> &v, std::shared_ptr<Expression> &&self);
+        virtual Expression substitute(std::string_view v, const Expression &exp, std::shared_ptr<Expression> &&self);
+        virtual Expression beta_reduction(std::shared_ptr<Expression> &&self);
 
-        virtual Expression avoid(const std::set<std::string> &v) const;
-        virtual Expression substitute(std::string_view v, const Expression &exp) const;
-        virtual Expression beta_reduction() const;
+        virtual Kind kind() const;
 
     public:
-        virtual ~Abstraction() {}
+        virtual ~Abstraction()
+        {
+            control::nodes.fetch_sub(1, std::memory_order_relaxed);
+        }
     };
 
     class Application : public Expression
@@ -140,21 +220,33 @@ namespace impl
         friend class Constant;
 
         Expression exp1, exp2;
+        bool normal;
 
         Application(const Expression &exp1, const Expression &exp2);
 
-        virtual Expression beta_impl(const Expression &exp) const;
+        virtual Expression beta_impl(const Expression &exp) const &;
 
         virtual std::string str() const;
         virtual std::set<std::string> free_variables() const;
         virtual std::set<std::string> bound_variables() const;
+        virtual bool is_normal() const;
+
+        virtual Expression avoid(const std::set<std::string> &v) const &;
+        virtual Expression substitute(std::string_view v, const Expression &exp) const &;
+        virtual Expression beta_reduction() const &;
 
-        virtual Expression avoid(const std::set<std::string> &v) const;
-        virtual Expression substitute(std::string_view v, const Expression &exp) const;
-        virtual Expression beta_reduction() const;
+        virtual Expression beta_impl(const Expression &exp, std::shared_ptr<Expression> &&self);
+        virtual Expression avoid(const std::set<std::string> &v, std::shared_ptr<Expression> &&self);
+        virtual Expression substitute(std::string_view v, const Expression &exp, std::shared_ptr<Expression> &&self);
+        virtual Expression beta_reduction(std::shared_ptr<Expression> &&self);
+
+        virtual Kind kind() const;
 
     public:
-        virtual ~Application() {}
+        virtual ~Application()
+        {
+            control::nodes.fetch_sub(1, std::memory_order_relaxed);
+        }
     };
 
     class Constant : public Expression, public Named
@@ -167,22 +259,34 @@ namespace impl
 
         Constant(std::string_view name);
 
-        virtual Expression beta_impl(const Expression &exp) const;
+        virtual Expression beta_impl(const Expression &exp) const &;
 
         virtual std::string str() const;
         virtual std::set<std::string> free_variables() const;
         virtual std::set<std::string> bound_variables() const;
+        virtual bool is_normal() const;
 
-        virtual Expression avoid(const std::set<std::string> &v) const;
-        virtual Expression substitute(std::string_view v, const Expression &exp) const;
-        virtual Expression beta_reduction() const;
+        virtual Expression avoid(const std::set<std::string> &v) const &;
+        virtual Expression substitute(std::string_view v, const Expression &exp) const &;
+        virtual Expression beta_reduction() const &;
+
+        virtual Expression beta_impl(const Expression &exp, std::shared_ptr<Expression> &&self);
+        virtual Expression avoid(const std::set<std::string> &v, std::shared_ptr<Expression> &&self);
+        virtual Expression substitute(std::string_view v, const Expression &exp, std::shared_ptr<Expression> &&self);
+        virtual Expression beta_reduction(std::shared_ptr<Expression> &&self);
+
+        virtual Kind kind() const;
 
     public:
-        virtual ~Constant() {}
+        virtual ~Constant()
+        {
+            control::nodes.fetch_sub(1, std::memory_order_relaxed);
+        }
     };
 
     Expression::Expression(std::string_view v, bool is_constant = false)
     {
+        profile::allocation();
         if (is_constant)
         {
             rep = std::shared_ptr<Constant>(new Constant(v));
@@ -195,24 +299,74 @@ namespace impl
 
     Expression::Expression(std::string_view x, const Expression &exp)
     {
+        profile::allocation();
         rep = std::shared_ptr<Abstraction>(new Abstraction(x, exp));
     }
 
+    Expression::Expression(std::string_view x, const Expression &exp, std::uint32_t origin)
+    {
+        profile::allocation();
+        rep = std::shared_ptr<Abstraction>(new Abstraction(x, exp, origin));
+    }
+
     Expression::Expression(const Expression &exp1, const Expression &exp2)
     {
+        profile::allocation();
         rep = std::shared_ptr<Application>(new Application(exp1, exp2));
     }
 
     Expression::Expression(BaseConstructor)
     {
         rep = nullptr;
+        control::nodes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Expression::Expression(std::shared_ptr<Expression> &&rep) : rep(std::move(rep))
+    {
+    }
+
+    bool Expression::unique() const
+    {
+        if (rep.use_count() != 1)
+            return false;
+        // pairs with the release of the last other owner, whose reads must finish before we write
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return true;
     }
 
-    Expression Expression::beta_impl(const Expression &exp) const
+    Expression Expression::beta_impl(const Expression &exp) const &
     {
         return rep->beta_impl(exp);
     }
 
+    Expression Expression::beta_impl(const Expression &exp) &&
+    {
+        if (!unique())
+            return rep->beta_impl(exp);
+        auto node = rep.get();
+        return node->beta_impl(exp, std::move(rep));
+    }
+
+    Expression Expression::beta_impl(const Expression &exp, std::shared_ptr<Expression> &&self)
+    {
+        return self->beta_impl(exp);
+    }
+
+    Expression Expression::avoid(const std::set<std::string> &v, std::shared_ptr<Expression> &&self)
+    {
+        return self->avoid(v);
+    }
+
+    Expression Expression::substitute(std::string_view v, const Expression &exp, std::shared_ptr<Expression> &&self)
+    {
+        return self->substitute(v, exp);
+    }
+
+    Expression Expression::beta_reduction(std::shared_ptr<Expression> &&self)
+    {
+        return self->beta_reduction();
+    }
+
     std::string Expression::str() const
     {
         return rep->str();
@@ -228,26 +382,122 @@ namespace impl
         return rep->bound_variables();
     }
 
-    Expression Expression::avoid(const std::set<std::string> &v) const
+    bool Expression::is_normal() const
+    {
+        return rep->is_normal();
+    }
+
+    Expression Expression::avoid(const std::set<std::string> &v) const &
     {
         return rep->avoid(v);
     }
 
-    Expression Expression::substitute(std::string_view v, const Expression &exp) const
+    Expression Expression::substitute(std::string_view v, const Expression &exp) const &
     {
         return rep->substitute(v, exp);
     }
 
-    Expression Expression::beta_reduction() const
+    Expression Expression::beta_reduction() const &
     {
+        if (is_normal())
+            return *this;
         return rep->beta_reduction();
     }
 
+    Expression Expression::avoid(const std::set<std::string> &v) &&
+    {
+        if (!unique())
+            return rep->avoid(v);
+        auto node = rep.get();
+        return node->avoid(v, std::move(rep));
+    }
+
+    Expression Expression::substitute(std::string_view v, const Expression &exp) &&
+    {
+        if (!unique())
+            return rep->substitute(v, exp);
+        auto node = rep.get();
+        return node->substitute(v, exp, std::move(rep));
+    }
+
+    Expression Expression::beta_reduction() &&
+    {
+        if (is_normal())
+            return std::move(*this);
+        if (!unique())
+            return rep->beta_reduction();
+        auto node = rep.get();
+        return node->beta_reduction(std::move(rep));
+    }
+
+    Expression::Kind Expression::kind() const
+    {
+        return rep->kind();
+    }
+
+    const std::string &Expression::symbol() const
+    {
+        switch (kind())
+        {
+        case Kind::variable:
+            return static_cast<const Variable &>(*rep).name;
+        case Kind::abstraction:
+            return static_cast<const Abstraction &>(*rep).arg.name;
+        case Kind::constant:
+            return static_cast<const Constant &>(*rep).name;
+        default:
+            throw std::logic_error("symbol() of an application");
+        }
+    }
+
+    const Expression &Expression::body() const
+    {
+        if (kind() != Kind::abstraction)
+            throw std::logic_error("body() of a non-abstraction");
+        return static_cast<const Abstraction &>(*rep).exp;
+    }
+
+    const Expression &Expression::function() const
+    {
+        if (kind() != Kind::application)
+            throw std::logic_error("function() of a non-application");
+        return static_cast<const Application &>(*rep).exp1;
+    }
+
+    const Expression &Expression::argument() const
+    {
+        if (kind() != Kind::application)
+            throw std::logic_error("argument() of a non-application");
+        return static_cast<const Application &>(*rep).exp2;
+    }
+
+    bool Expression::identical(const Expression &exp) const
+    {
+        return rep == exp.rep;
+    }
+
+    std::uint32_t Expression::origin() const
+    {
+        if (kind() != Kind::abstraction)
+            return 0;
+        return static_cast<const Abstraction &>(*rep).origin;
+    }
+
+    Expression Expression::apply(const Expression &exp) const &
+    {
+        return beta_impl(exp);
+    }
+
+    Expression Expression::apply(const Expression &exp) &&
+    {
+        return std::move(*this).beta_impl(exp);
+    }
+
     Variable::Variable(std::string_view v) : Expression(BaseConstructor()), Named(v)
     {
     }
 
-    Expression Variable::beta_impl(const Expression &exp) const
+    Expression Variable::beta_impl(const Expression &exp) const &
     {
         if (debugprint)
         {
@@ -271,12 +521,17 @@ namespace impl
         return {};
     }
 
-    Expression Variable::avoid(const std::set<std::string> &v) const
+    bool Variable::is_normal() const
+    {
+        return true;
+    }
+
+    Expression Variable::avoid(const std::set<std::string> &v) const &
     {
         return Expression(name);
     }
 
-    Expression Variable::substitute(std::string_view v, const Expression &exp) const
+    Expression Variable::substitute(std::string_view v, const Expression &exp) const &
     {
         if (debugprint)
             std::printf("variable(%s)::substitute(%s, %s)\n", name.c_str(), v.data(), exp.str().c_str());
@@ -292,29 +547,58 @@ namespace impl
         return res;
     }
 
-    Expression Variable::beta_reduction() const
+    Expression Variable::beta_reduction() const &
     {
         return Expression(name);
     }
 
-    Abstraction::Abstraction(std::string_view x, const Expression &exp) : Expression(BaseConstructor()), arg(x), exp(exp)
+    Expression Variable::beta_impl(const Expression &exp, std::shared_ptr<Expression> &&self)
+    {
+        return Expression(Expression(std::move(self)), exp);
+    }
+
+    Expression Variable::avoid(const std::set<std::string> &, std::shared_ptr<Expression> &&self)
     {
+        return Expression(std::move(self));
     }
 
-    Abstraction::Abstraction(const Variable &x, const Expression &exp) : Expression(BaseConstructor()), arg(x), exp(exp)
+    Expression Variable::substitute(std::string_view v, const Expression &exp, std::shared_ptr<Expression> &&self)
     {
+        if (name != v)
+            return Expression(std::move(self));
+        return exp;
     }
 
-    Expression Abstraction::beta_impl(const Expression &exp) const
+    Expression Variable::beta_reduction(std::shared_ptr<Expression> &&self)
     {
+        return Expression(std::move(self));
+    }
+
+    Expression::Kind Variable::kind() const
+    {
+        return Kind::variable;
+    }
+
+    Abstraction::Abstraction(std::string_view x, const Expression &exp, std::uint32_t origin) : Expression(BaseConstructor()), arg(x), exp(exp), origin(origin), normal(exp.is_normal())
+    {
+    }
+
+    Abstraction::Abstraction(const Variable &x, const Expression &exp) : Expression(BaseConstructor()), arg(x), exp(exp), origin(0), normal(exp.is_normal())
+    {
+    }
+
+    Expression Abstraction::beta_impl(const Expression &exp) const &
+    {
+        control::step();
+        profile::Scope scope(origin);
         if (debugprint)
         {
-            std::printf("abstraction(%s, %s)::beta_impl(%s)\n", arg.str().c_str(), this->exp.str().c_str(), exp.str().c_str());
+            std::printf("abstraction(%s, %s)::beta_impl(%s)\n", arg.name.c_str(), this->exp.str().c_str(), exp.str().c_str());
         }
 
         auto vars = exp.free_variables();
-        vars.merge(exp.bound_variables());
-
+        if (vars.empty())
+            return this->exp.substitute(arg.name, exp);
         return this->exp.avoid(vars).substitute(arg.name, exp);
     }
 
@@ -337,48 +621,112 @@ namespace impl
         return res;
     }
 
-    Expression Abstraction::avoid(const std::set<std::string> &v) const
+    bool Abstraction::is_normal() const
     {
+        return normal;
+    }
+
+    std::string Abstraction::fresh(const Expression &body, const std::set<std::string> &v) const
+    {
+        auto used = body.bound_variables();
+        used.merge(body.free_variables());
+        used.merge(std::set<std::string>(v));
+        std::string newname = {next_letter(arg.name.at(0))};
+        while (used.contains(newname))
+        {
+            newname.at(0) = next_letter(newname.at(0));
+            if (newname.at(0) == arg.name.at(0))
+                newname += "'";
+        }
+        return newname;
+    }
+
+    Expression Abstraction::avoid(const std::set<std::string> &v) const &
+    {
+        auto body = exp.avoid(v);
         if (v.contains(arg.name))
         {
-            auto used = exp.bound_variables();
-            used.merge(std::set<std::string>(v));
-            char tmp = next_letter(arg.name.at(0));
-            while (used.contains(std::string(&tmp)))
-            {
-                tmp = next_letter(tmp);
-            }
-            std::string newname = {tmp};
-            return Expression(newname, this->exp.substitute(arg.name, Expression(newname)));
+            auto newname = fresh(body, v);
+            return Expression(newname, std::move(body).substitute(arg.name, Expression(newname)), origin);
         }
-        return Expression(arg.name, exp);
+        return Expression(arg.name, body, origin);
     }
 
-    Expression Abstraction::substitute(std::string_view v, const Expression &exp) const
+    Expression Abstraction::substitute(std::string_view v, const Expression &exp) const &
     {
         if (debugprint)
             std::printf("abstraction(%s, %s)::substitute(%s, %s)\n", arg.name.c_str(), this->exp.str().c_str(), v.data(), exp.str().c_str());
         if (arg.name != v)
         {
-            return Expression(arg.name, this->exp.substitute(v, exp));
+            return Expression(arg.name, this->exp.substitute(v, exp), origin);
+        }
+        return Expression(arg.name, this->exp, origin);
+    }
+
+    Expression Abstraction::beta_reduction() const &
+    {
+        if (debugprint)
+        {
+            std::printf("abstraction(%s, %s)::beta_reduction()\n", arg.name.c_str(), exp.str().c_str());
         }
-        return Expression(arg.name, this->exp);
+        return Expression(arg.name, exp.beta_reduction(), origin);
     }
 
-    Expression Abstraction::beta_reduction() const
+    Expression Abstraction::beta_impl(const Expression &exp, [[maybe_unused]] std::shared_ptr<Expression> &&self)
     {
+        control::step();
+        profile::Scope scope(origin);
         if (debugprint)
         {
-            std::printf("abstraction(%s, %s)::beta_reduction()\n", arg.str().c_str(), exp.str().c_str());
+            std::printf("abstraction(%s, %s)::beta_impl(%s) in place\n", arg.name.c_str(), this->exp.str().c_str(), exp.str().c_str());
+        }
+
+        // self keeps arg alive until the body has been rewritten
+        auto vars = exp.free_variables();
+        if (vars.empty())
+            return std::move(this->exp).substitute(arg.name, exp);
+        return std::move(this->exp).avoid(vars).substitute(arg.name, exp);
+    }
+
+    Expression Abstraction::avoid(const std::set<std::string> &v, std::shared_ptr<Expression> &&self)
+    {
+        // renaming keeps every redex, so normal stays valid
+        exp = std::move(exp).avoid(v);
+        if (v.contains(arg.name))
+        {
+            auto newname = fresh(exp, v);
+            return Expression(newname, std::move(exp).substitute(arg.name, Expression(newname)), origin);
+        }
+        return Expression(std::move(self));
+    }
+
+    Expression Abstraction::substitute(std::string_view v, const Expression &exp, std::shared_ptr<Expression> &&self)
+    {
+        if (arg.name != v)
+        {
+            this->exp = std::move(this->exp).substitute(v, exp);
+            normal = this->exp.is_normal();
         }
-        return Expression(arg.name, exp.beta_reduction());
+        return Expression(std::move(self));
+    }
+
+    Expression Abstraction::beta_reduction(std::shared_ptr<Expression> &&self)
+    {
+        exp = std::move(exp).beta_reduction();
+        normal = exp.is_normal();
+        return Expression(std::move(self));
+    }
+
+    Expression::Kind Abstraction::kind() const
+    {
+        return Kind::abstraction;
     }
 
-    Application::Application(const Expression &exp1, const Expression &exp2) : Expression(BaseConstructor()), exp1(exp1), exp2(exp2)
+    Application::Application(const Expression &exp1, const Expression &exp2) : Expression(BaseConstructor()), exp1(exp1), exp2(exp2), normal(exp1.kind() != Kind::abstraction && exp1.is_normal() && exp2.is_normal())
     {
     }
 
-    Expression Application::beta_impl(const Expression &exp) const
+    Expression Application::beta_impl(const Expression &exp) const &
     {
         if (debugprint)
         {
@@ -406,12 +754,17 @@ namespace impl
         return res;
     }
 
-    Expression Application::avoid(const std::set<std::string> &v) const
+    bool Application::is_normal() const
+    {
+        return normal;
+    }
+
+    Expression Application::avoid(const std::set<std::string> &v) const &
     {
         return Expression(exp1.avoid(v), exp2.avoid(v));
     }
 
-    Expression Application::substitute(std::string_view v, const Expression &exp) const
+    Expression Application::substitute(std::string_view v, const Expression &exp) const &
     {
         if (debugprint)
         {
@@ -421,7 +774,7 @@ namespace impl
         return Expression(exp1.substitute(v, exp), exp2.substitute(v, exp));
     }
 
-    Expression Application::beta_reduction() const
+    Expression Application::beta_reduction() const &
     {
         if (debugprint)
         {
@@ -430,11 +783,54 @@ namespace impl
         return (exp1.beta_reduction()).beta_impl(exp2.beta_reduction());
     }
 
+    Expression Application::beta_impl(const Expression &exp, std::shared_ptr<Expression> &&self)
+    {
+        return Expression(Expression(std::move(self)), exp);
+    }
+
+    Expression Application::avoid(const std::set<std::string> &v, std::shared_ptr<Expression> &&self)
+    {
+        exp1 = std::move(exp1).avoid(v);
+        exp2 = std::move(exp2).avoid(v);
+        return Expression(std::move(self));
+    }
+
+    Expression Application::substitute(std::string_view v, const Expression &exp, std::shared_ptr<Expression> &&self)
+    {
+        if (debugprint)
+        {
+            std::printf("application(%s, %s)::substitute(%s, %s) in place\n", exp1.str().c_str(), exp2.str().c_str(), v.data(), exp.str().c_str());
+        }
+
+        exp1 = std::move(exp1).substitute(v, exp);
+        exp2 = std::move(exp2).substitute(v, exp);
+        normal = (exp1.kind() != Kind::abstraction && exp1.is_normal() && exp2.is_normal());
+        return Expression(std::move(self));
+    }
+
+    Expression Application::beta_reduction(std::shared_ptr<Expression> &&self)
+    {
+        exp1 = std::move(exp1).beta_reduction();
+        exp2 = std::move(exp2).beta_reduction();
+        if (exp1.kind() != Kind::abstraction)
+        {
+            normal = (exp1.is_normal() && exp2.is_normal());
+            return Expression(std::move(self));
+        }
+        auto f = std::move(exp1);
+        return std::move(f).beta_impl(exp2);
+    }
+
+    Expression::Kind Application::kind() const
+    {
+        return Kind::application;
+    }
+
     Constant::Constant(std::string_view name) : Expression(BaseConstructor()), Named(name)
     {
     }
 
-    Expression Constant::beta_impl(const Expression &exp) const
+    Expression Constant::beta_impl(const Expression &exp) const &
     {
         if (debugprint)
         {
@@ -458,12 +854,17 @@ namespace impl
         return {};
     }
 
-    Expression Constant::avoid(const std::set<std::string> &v) const
+    bool Constant::is_normal() const
+    {
+        return true;
+    }
+
+    Expression Constant::avoid(const std::set<std::string> &v) const &
     {
         return Expression(name, true);
     }
 
-    Expression Constant::substitute(std::string_view v, const Expression &exp) const
+    Expression Constant::substitute(std::string_view v, const Expression &exp) const &
     {
         if (debugprint)
             std::printf("constant(%s)::substitute(%s, %s)\n", name.c_str(), v.data(), exp.str().c_str());
@@ -479,11 +880,38 @@ namespace impl
         return res;
     }
 
-    Expression Constant::beta_reduction() const
+    Expression Constant::beta_reduction() const &
+    {
+        return Expression(name);
+    }
+
+    Expression Constant::beta_impl(const Expression &exp, std::shared_ptr<Expression> &&)
+    {
+        return Expression(Expression(name), exp);
+    }
+
+    Expression Constant::avoid(const std::set<std::string> &, std::shared_ptr<Expression> &&self)
+    {
+        return Expression(std::move(self));
+    }
+
+    Expression Constant::substitute(std::string_view v, const Expression &exp, std::shared_ptr<Expression> &&self)
+    {
+        if (name != v)
+            return Expression(std::move(self));
+        return exp;
+    }
+
+    Expression Constant::beta_reduction(std::shared_ptr<Expression> &&)
     {
         return Expression(name);
     }
 
+    Expression::Kind Constant::kind() const
+    {
+        return Kind::constant;
+    }
+
     class LambdaException : public std::exception
     {
     public:
@@ -529,4 +957,18 @@ Expression Constant(std::string_view name)
     return Expression(name, true);
 }
 
+// marks the abstractions of exp as inlined through the definition name
+Expression Tagged(const Expression &exp, std::string_view name)
+{
+    switch (exp.kind())
+    {
+    case Expression::Kind::abstraction:
+        return Expression(exp.symbol(), Tagged(exp.body(), name), profile::origins().intern(name, exp.origin()));
+    case Expression::Kind::application:
+        return Expression(Tagged(exp.function(), name), Tagged(exp.argument(), name));
+    default:
+        return exp;
+    }
+}
+
 #endif
\ No newline at end of file
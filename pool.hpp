@@ -0,0 +1,387 @@
+#ifndef INCLUDED_POOL_HPP
+#define INCLUDED_POOL_HPP
+
+#include "lambda.hpp"
+#include "reducer.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Compact term store for normal order reduction.
+// Nodes are 12 bytes in one contiguous vector, addressed by 32-bit indices and
+// dispatched on a tag instead of virtual calls. Bound variables are de Bruijn
+// indices, so contraction needs no renaming; binder names are only kept as
+// hints for the read-back.
+namespace pool
+{
+    enum class Tag : std::uint32_t
+    {
+        bound,       // lhs: de Bruijn index
+        free,        // lhs: symbol, rhs: 1 for a constant
+        abstraction, // lhs: body, rhs: binder symbol
+        application  // lhs: function, rhs: argument
+    };
+
+    // info holds the tag in its low two bits and, above them, one more than the
+    // largest index escaping the node (0 for closed terms), so substitution and
+    // shifting return closed subterms such as inlined definitions untouched
+    struct Node
+    {
+        std::uint32_t info;
+        std::uint32_t lhs;
+        std::uint32_t rhs;
+
+        Tag tag() const
+        {
+            return static_cast<Tag>(info & 3u);
+        }
+
+        std::uint32_t loose() const
+        {
+            return info >> 2;
+        }
+    };
+
+    static_assert(sizeof(Node) == 12);
+
+    // a pool owns its nodes; use one per thread
+    class Pool
+    {
+    public:
+        Pool();
+
+        // evaluates exp to normal form, resolving free names against env
+        Expression normalize(const Expression &exp, const Environment &env);
+
+        // nodes currently allocated, including those kept for definitions
+        std::size_t size() const;
+
+    private:
+        // unresolved: names compiled as free because they were not defined
+        // yet, including those of the globals it refers to
+        struct Global
+        {
+            Expression source;
+            std::uint32_t node;
+            std::set<std::string> unresolved;
+        };
+
+        std::vector<Node> nodes;
+        std::vector<std::string> symbols;
+        std::map<std::string, std::uint32_t> symbol_ids;
+        std::map<std::string, Global> globals;
+        std::vector<std::set<std::string>> unresolved; // of the globals being compiled, innermost last
+
+        // nodes below the mark belong to globals and survive between lines
+        std::size_t mark;
+
+        std::uint32_t intern(const std::string &name);
+        std::uint32_t make(Tag tag, std::uint32_t lhs, std::uint32_t rhs);
+        std::uint32_t global(const std::string &name, const Environment &env);
+        void prepare(const Expression &exp, std::vector<std::string> &scope, const Environment &env, const std::string &owner);
+        std::uint32_t convert(const Expression &exp, std::vector<std::string> &scope, const Environment &env, const std::string &owner);
+
+        std::uint32_t shift(std::uint32_t exp, std::uint32_t d, std::uint32_t cutoff);
+        std::uint32_t substitute(std::uint32_t exp, std::uint32_t depth, std::uint32_t arg);
+        std::uint32_t whnf(std::uint32_t exp);
+        std::uint32_t reduce(std::uint32_t exp);
+
+        void free_symbols(std::uint32_t exp, std::set<std::string> &res, std::vector<bool> &visited) const;
+        Expression readback(std::uint32_t exp, std::vector<std::string> &names, const std::set<std::string> &used) const;
+        std::string fresh(const std::string &hint, const std::vector<std::string> &names, const std::set<std::string> &used) const;
+    };
+
+    Pool::Pool() : mark(0)
+    {
+    }
+
+    std::size_t Pool::size() const
+    {
+        return nodes.size();
+    }
+
+    std::uint32_t Pool::intern(const std::string &name)
+    {
+        auto it = symbol_ids.find(name);
+        if (it != symbol_ids.end())
+            return it->second;
+        symbols.push_back(name);
+        symbol_ids.emplace(name, symbols.size() - 1);
+        return symbols.size() - 1;
+    }
+
+    std::uint32_t Pool::make(Tag tag, std::uint32_t lhs, std::uint32_t rhs)
+    {
+        if (nodes.size() == 0xffffffffu)
+            throw std::length_error("pool: out of node indices");
+        std::uint32_t loose = 0;
+        switch (tag)
+        {
+        case Tag::bound:
+            loose = lhs + 1;
+            break;
+        case Tag::abstraction:
+            loose = nodes[lhs].loose() ? nodes[lhs].loose() - 1 : 0;
+            break;
+        case Tag::application:
+            loose = std::max(nodes[lhs].loose(), nodes[rhs].loose());
+            break;
+        default:
+            break;
+        }
+        nodes.push_back({(loose << 2) | static_cast<std::uint32_t>(tag), lhs, rhs});
+        return nodes.size() - 1;
+    }
+
+    std::uint32_t Pool::global(const std::string &name, const Environment &env)
+    {
+        auto def = env.find(name);
+        auto it = globals.find(name);
+        // a global is compiled again once a name it left free has been defined
+        if (it != globals.end() && it->second.source.identical(def->exp) && !env.defines_any(it->second.unresolved))
+            return it->second.node;
+
+        unresolved.emplace_back();
+        std::vector<std::string> scope;
+        prepare(def->exp, scope, env, name);
+        auto node = convert(def->exp, scope, env, name);
+        auto names = std::move(unresolved.back());
+        unresolved.pop_back();
+
+        mark = nodes.size();
+        globals.insert_or_assign(name, Global{def->exp, node, std::move(names)});
+        return node;
+    }
+
+    void Pool::prepare(const Expression &exp, std::vector<std::string> &scope, const Environment &env, const std::string &owner)
+    {
+        switch (exp.kind())
+        {
+        case Expression::Kind::variable:
+        case Expression::Kind::constant:
+            for (auto &&name : scope)
+            {
+                if (exp.kind() == Expression::Kind::variable && name == exp.symbol())
+                    return;
+            }
+            if (env.resolve(exp.symbol(), owner))
+                global(exp.symbol(), env);
+            break;
+        case Expression::Kind::abstraction:
+            scope.push_back(exp.symbol());
+            prepare(exp.body(), scope, env, owner);
+            scope.pop_back();
+            break;
+        case Expression::Kind::application:
+            prepare(exp.function(), scope, env, owner);
+            prepare(exp.argument(), scope, env, owner);
+            break;
+        }
+    }
+
+    std::uint32_t Pool::convert(const Expression &exp, std::vector<std::string> &scope, const Environment &env, const std::string &owner)
+    {
+        switch (exp.kind())
+        {
+        case Expression::Kind::abstraction:
+        {
+            scope.push_back(exp.symbol());
+            auto body = convert(exp.body(), scope, env, owner);
+            scope.pop_back();
+            return make(Tag::abstraction, body, intern(exp.symbol()));
+        }
+        case Expression::Kind::application:
+        {
+            auto f = convert(exp.function(), scope, env, owner);
+            return make(Tag::application, f, convert(exp.argument(), scope, env, owner));
+        }
+        default:
+            break;
+        }
+
+        bool is_constant = (exp.kind() == Expression::Kind::constant);
+        for (std::size_t i = scope.size(); i > 0 && !is_constant; i--)
+        {
+            if (scope.at(i - 1) == exp.symbol())
+                return make(Tag::bound, static_cast<std::uint32_t>(scope.size() - i), 0);
+        }
+        if (env.resolve(exp.symbol(), owner))
+        {
+            auto node = global(exp.symbol(), env);
+            if (!unresolved.empty())
+                unresolved.back().insert(globals.at(exp.symbol()).unresolved.begin(), globals.at(exp.symbol()).unresolved.end());
+            return node;
+        }
+        if (!unresolved.empty() && owner < exp.symbol())
+            unresolved.back().insert(exp.symbol());
+        return make(Tag::free, intern(exp.symbol()), is_constant);
+    }
+
+    std::uint32_t Pool::shift(std::uint32_t exp, std::uint32_t d, std::uint32_t cutoff)
+    {
+        auto n = nodes[exp];
+        if (d == 0 || n.loose() <= cutoff)
+            return exp;
+        switch (n.tag())
+        {
+        case Tag::bound:
+            return make(Tag::bound, n.lhs + d, 0);
+        case Tag::abstraction:
+            return make(Tag::abstraction, shift(n.lhs, d, cutoff + 1), n.rhs);
+        case Tag::application:
+        {
+            auto f = shift(n.lhs, d, cutoff);
+            return make(Tag::application, f, shift(n.rhs, d, cutoff));
+        }
+        default:
+            return exp;
+        }
+    }
+
+    // exp[depth := arg], removing the binder of depth
+    std::uint32_t Pool::substitute(std::uint32_t exp, std::uint32_t depth, std::uint32_t arg)
+    {
+        auto n = nodes[exp];
+        if (n.loose() <= depth)
+            return exp;
+        switch (n.tag())
+        {
+        case Tag::bound:
+            if (n.lhs == depth)
+                return shift(arg, depth, 0);
+            return make(Tag::bound, n.lhs - 1, 0);
+        case Tag::abstraction:
+            return make(Tag::abstraction, substitute(n.lhs, depth + 1, arg), n.rhs);
+        case Tag::application:
+        {
+            auto f = substitute(n.lhs, depth, arg);
+            return make(Tag::application, f, substitute(n.rhs, depth, arg));
+        }
+        default:
+            return exp;
+        }
+    }
+
+    std::uint32_t Pool::whnf(std::uint32_t exp)
+    {
+        while (nodes[exp].tag() == Tag::application)
+        {
+            auto n = nodes[exp];
+            auto f = whnf(n.lhs);
+            if (nodes[f].tag() != Tag::abstraction)
+                return (f == n.lhs) ? exp : make(Tag::application, f, n.rhs);
+            control::step();
+            exp = substitute(nodes[f].lhs, 0, n.rhs);
+        }
+        return exp;
+    }
+
+    std::uint32_t Pool::reduce(std::uint32_t exp)
+    {
+        exp = whnf(exp);
+        auto n = nodes[exp];
+        if (n.tag() == Tag::abstraction)
+        {
+            auto body = reduce(n.lhs);
+            return (body == n.lhs) ? exp : make(Tag::abstraction, body, n.rhs);
+        }
+        if (n.tag() == Tag::application)
+        {
+            auto f = reduce(n.lhs);
+            auto a = reduce(n.rhs);
+            return (f == n.lhs && a == n.rhs) ? exp : make(Tag::application, f, a);
+        }
+        return exp;
+    }
+
+    void Pool::free_symbols(std::uint32_t exp, std::set<std::string> &res, std::vector<bool> &visited) const
+    {
+        if (visited.at(exp))
+            return;
+        visited.at(exp) = true;
+        auto n = nodes[exp];
+        switch (n.tag())
+        {
+        case Tag::free:
+            res.insert(symbols.at(n.lhs));
+            break;
+        case Tag::abstraction:
+            free_symbols(n.lhs, res, visited);
+            break;
+        case Tag::application:
+            free_symbols(n.lhs, res, visited);
+            free_symbols(n.rhs, res, visited);
+            break;
+        default:
+            break;
+        }
+    }
+
+    Expression Pool::readback(std::uint32_t exp, std::vector<std::string> &names, const std::set<std::string> &used) const
+    {
+        auto n = nodes[exp];
+        switch (n.tag())
+        {
+        case Tag::bound:
+            return Expression(names.at(names.size() - 1 - n.lhs));
+        case Tag::free:
+            return Expression(symbols.at(n.lhs), n.rhs != 0);
+        case Tag::abstraction:
+        {
+            names.push_back(fresh(symbols.at(n.rhs), names, used));
+            auto body = readback(n.lhs, names, used);
+            auto res = Expression(names.back(), body);
+            names.pop_back();
+            return res;
+        }
+        default:
+        {
+            auto f = readback(n.lhs, names, used);
+            return Expression(f, readback(n.rhs, names, used));
+        }
+        }
+    }
+
+    std::string Pool::fresh(const std::string &hint, const std::vector<std::string> &names, const std::set<std::string> &used) const
+    {
+        auto taken = [&](const std::string &name)
+        {
+            for (auto &&n : names)
+            {
+                if (n == name)
+                    return true;
+            }
+            return used.contains(name);
+        };
+        auto res = hint;
+        while (taken(res))
+        {
+            char c = impl::next_letter(res.at(0));
+            if (c == hint.at(0))
+                res += "'";
+            res.at(0) = c;
+        }
+        return res;
+    }
+
+    Expression Pool::normalize(const Expression &exp, const Environment &env)
+    {
+        std::vector<std::string> scope, names;
+        std::set<std::string> used;
+        nodes.resize(mark);
+        prepare(exp, scope, env, "");
+        auto res = reduce(convert(exp, scope, env, ""));
+
+        std::vector<bool> visited(nodes.size(), false);
+        free_symbols(res, used, visited);
+        auto out = readback(res, names, used);
+        nodes.resize(mark);
+        return out;
+    }
+}
+
+#endif
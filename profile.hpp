@@ -0,0 +1,178 @@
+#ifndef INCLUDED_PROFILE_HPP
+#define INCLUDED_PROFILE_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Attribution of reduction work to definitions.
+// Abstractions carry an origin: the chain of definitions their body was
+// inlined through, outermost first ("mult;plus;succ"). Contracting a redex
+// charges its step, time and node allocations to the origin of the abstraction.
+namespace profile
+{
+    // interned chains of definition names, 0 is the empty chain
+    class Origins
+    {
+    public:
+        Origins() : chains(1) {}
+
+        std::uint32_t intern(std::string_view name, std::uint32_t tail)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto key = std::make_pair(std::string(name), tail);
+            auto it = ids.find(key);
+            if (it != ids.end())
+                return it->second;
+            chains.push_back({key.first, tail});
+            ids.emplace(key, chains.size() - 1);
+            return chains.size() - 1;
+        }
+
+        std::vector<std::string> path(std::uint32_t origin)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::vector<std::string> res;
+            while (origin != 0)
+            {
+                res.push_back(chains.at(origin).first);
+                origin = chains.at(origin).second;
+            }
+            return res;
+        }
+
+    private:
+        std::mutex mutex;
+        std::vector<std::pair<std::string, std::uint32_t>> chains;
+        std::map<std::pair<std::string, std::uint32_t>, std::uint32_t> ids;
+    };
+
+    Origins &origins()
+    {
+        static Origins table;
+        return table;
+    }
+
+    struct Entry
+    {
+        std::size_t steps = 0;
+        std::size_t allocations = 0;
+        std::chrono::nanoseconds time{0};
+    };
+
+    class Profiler
+    {
+    public:
+        std::map<std::uint32_t, Entry> entries;
+
+        // definitions sorted by the steps spent in them, including the definitions they inline
+        void report(std::ostream &os)
+        {
+            struct Row
+            {
+                std::string name;
+                Entry self, total;
+            };
+            std::map<std::string, Row> rows;
+            Entry all;
+            for (auto &&[origin, e] : entries)
+            {
+                auto path = origins().path(origin);
+                if (path.empty())
+                    path.push_back("(line)");
+                for (auto &&name : std::set<std::string>(path.begin(), path.end()))
+                {
+                    rows[name].name = name;
+                    add(rows[name].total, e);
+                }
+                add(rows[path.back()].self, e);
+                add(all, e);
+            }
+
+            std::vector<Row> sorted;
+            for (auto &&[name, row] : rows)
+                sorted.push_back(row);
+            std::sort(sorted.begin(), sorted.end(), [](const Row &a, const Row &b)
+                      { return a.total.steps > b.total.steps; });
+
+            char buf[256];
+            std::snprintf(buf, sizeof(buf), "%-16s %10s %10s %7s %12s %12s\n", "definition", "self", "total", "%", "allocations", "time(us)");
+            os << buf;
+            for (auto &&row : sorted)
+            {
+                double percent = all.steps ? 100.0 * row.total.steps / all.steps : 0.0;
+                std::snprintf(buf, sizeof(buf), "%-16s %10zu %10zu %6.1f%% %12zu %12lld\n", row.name.c_str(), row.self.steps, row.total.steps, percent, row.total.allocations,
+                              static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(row.total.time).count()));
+                os << buf;
+            }
+        }
+
+        // one "outer;inner time" line per chain, for flamegraph tools
+        void folded(std::ostream &os)
+        {
+            for (auto &&[origin, e] : entries)
+            {
+                auto path = origins().path(origin);
+                if (path.empty())
+                    path.push_back("(line)");
+                for (std::size_t i = 0; i < path.size(); i++)
+                    os << (i ? ";" : "") << path.at(i);
+                os << " " << e.time.count() << "\n";
+            }
+        }
+
+    private:
+        static void add(Entry &to, const Entry &e)
+        {
+            to.steps += e.steps;
+            to.allocations += e.allocations;
+            to.time += e.time;
+        }
+    };
+
+    thread_local Profiler *active = nullptr;
+    thread_local std::uint32_t current = 0;
+
+    // charges one contraction to origin for the lifetime of the scope
+    class Scope
+    {
+    public:
+        Scope(std::uint32_t origin) : saved(current)
+        {
+            if (!active)
+                return;
+            active->entries[origin].steps++;
+            current = origin;
+            start = std::chrono::steady_clock::now();
+        }
+
+        ~Scope()
+        {
+            if (!active)
+                return;
+            active->entries[current].time += std::chrono::steady_clock::now() - start;
+            current = saved;
+        }
+
+    private:
+        std::uint32_t saved;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    void allocation()
+    {
+        if (active)
+            active->entries[current].allocations++;
+    }
+}
+
+#endif
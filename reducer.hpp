@@ -2,10 +2,15 @@
 #define INCLUDED_REDUCER_HPP
 #include "lambda.hpp"
 #include "lexer.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
 #include <memory>
+#include <set>
 #include <stack>
 #include <string>
 #include <utility>
+#include <vector>
 
 struct Definition
 {
@@ -26,7 +31,213 @@ struct Definition
     }
 };
 
-using Environment = std::set<Definition>;
+// Persistent map of definitions ordered by name (an AVL tree with path copying).
+// Nodes are immutable and shared between versions, so copying an Environment is
+// a constant time snapshot: it never observes later insertions, and threads can
+// evaluate against their own copies of one prelude without locking.
+// A single Environment object is a plain value and must not be written while
+// another thread reads it.
+class Environment
+{
+private:
+    struct Node
+    {
+        Definition def;
+        std::shared_ptr<const Node> left, right;
+        int height;
+    };
+    using Link = std::shared_ptr<const Node>;
+
+    Link root;
+    std::size_t count = 0;
+
+    static int height(const Link &n)
+    {
+        return n ? n->height : 0;
+    }
+
+    static Link make(const Definition &def, const Link &left, const Link &right)
+    {
+        return std::make_shared<const Node>(Node{def, left, right, 1 + std::max(height(left), height(right))});
+    }
+
+    static Link balance(const Definition &def, const Link &left, const Link &right)
+    {
+        if (height(left) > height(right) + 1)
+        {
+            if (height(left->left) >= height(left->right))
+                return make(left->def, left->left, make(def, left->right, right));
+            auto &lr = left->right;
+            return make(lr->def, make(left->def, left->left, lr->left), make(def, lr->right, right));
+        }
+        if (height(right) > height(left) + 1)
+        {
+            if (height(right->right) >= height(right->left))
+                return make(right->def, make(def, left, right->left), right->right);
+            auto &rl = right->left;
+            return make(rl->def, make(def, left, rl->left), make(right->def, rl->right, right->right));
+        }
+        return make(def, left, right);
+    }
+
+    static Link insert(const Link &n, const Definition &def, bool &inserted)
+    {
+        if (!n)
+        {
+            inserted = true;
+            return make(def, nullptr, nullptr);
+        }
+        if (def.name < n->def.name)
+        {
+            auto left = insert(n->left, def, inserted);
+            return inserted ? balance(n->def, left, n->right) : n;
+        }
+        if (n->def.name < def.name)
+        {
+            auto right = insert(n->right, def, inserted);
+            return inserted ? balance(n->def, n->left, right) : n;
+        }
+        return n;
+    }
+
+public:
+    class const_iterator
+    {
+    public:
+        using value_type = Definition;
+        using reference = const Definition &;
+        using pointer = const Definition *;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        const_iterator() {}
+        const_iterator(const Node *n)
+        {
+            descend(n);
+        }
+
+        reference operator*() const
+        {
+            return path.back()->def;
+        }
+
+        pointer operator->() const
+        {
+            return &path.back()->def;
+        }
+
+        const_iterator &operator++()
+        {
+            auto n = path.back();
+            path.pop_back();
+            descend(n->right.get());
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            auto res = *this;
+            ++*this;
+            return res;
+        }
+
+        bool operator==(const const_iterator &it) const
+        {
+            return path == it.path;
+        }
+
+        bool operator!=(const const_iterator &it) const
+        {
+            return path != it.path;
+        }
+
+    private:
+        std::vector<const Node *> path;
+
+        void descend(const Node *n)
+        {
+            while (n)
+            {
+                path.push_back(n);
+                n = n->left.get();
+            }
+        }
+    };
+    using iterator = const_iterator;
+
+    Environment() {}
+
+    const_iterator begin() const
+    {
+        return const_iterator(root.get());
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator();
+    }
+
+    std::size_t size() const
+    {
+        return count;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    const Definition *find(std::string_view name) const
+    {
+        auto n = root.get();
+        while (n)
+        {
+            if (name < n->def.name)
+                n = n->left.get();
+            else if (n->def.name < name)
+                n = n->right.get();
+            else
+                return &n->def;
+        }
+        return nullptr;
+    }
+
+    // the definition name stands for inside the definition of owner, or inside
+    // a line for "": evaluate() substitutes definitions once each in name
+    // order, so a definition only has the names ordered after it replaced
+    const Definition *resolve(std::string_view name, std::string_view owner) const
+    {
+        return (owner < name) ? find(name) : nullptr;
+    }
+
+    bool defines_any(const std::set<std::string> &names) const
+    {
+        for (auto &&name : names)
+        {
+            if (find(name))
+                return true;
+        }
+        return false;
+    }
+
+    // the version with def added; like std::set, an existing name is kept
+    Environment inserted(const Definition &def) const
+    {
+        bool added = false;
+        Environment res;
+        res.root = insert(root, def, added);
+        res.count = count + (added ? 1 : 0);
+        return res;
+    }
+
+    bool insert(const Definition &def)
+    {
+        auto res = inserted(def);
+        bool added = res.count != count;
+        *this = std::move(res);
+        return added;
+    }
+};
 
 std::pair<Definition, Expression> reduce(std::vector<lex_unit> lex_units)
 {
@@ -56,7 +267,7 @@ std::pair<Definition, Expression> reduce(std::vector<lex_unit> lex_units)
     size_t index = 0;
     while (index < lex_units.size())
     {
-        auto &lex = lex_units.at(index);
+        auto lex = lex_units.at(index);
         if (lex.type == term::variable)
         {
             ent.emplace(lex.str);
@@ -0,0 +1,273 @@
+#ifndef INCLUDED_SIMPLIFY_HPP
+#define INCLUDED_SIMPLIFY_HPP
+
+#include "lambda.hpp"
+#include "reducer.hpp"
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Rewrites applied to a line before it is reduced.
+// inline: replaces names of definitions that are small or used once by their
+//         bodies, so the other passes can see through them
+// fold:   (λx.x) a => a and (λx.λy.x) a b => a
+// dead:   (λx.m) a => m when x does not occur in m, without reducing a
+// eta:    λx.f x => f when x does not occur in f; changes printed normal
+//         forms, so it is only run when asked for
+namespace simplify
+{
+    struct Options
+    {
+        bool inline_definitions = false;
+        bool fold = false;
+        bool dead = false;
+        bool eta = false;
+        std::size_t inline_size = 16; // largest body inlined at every use, in nodes
+    };
+
+    struct Stats
+    {
+        std::size_t inlined = 0;
+        std::size_t folded = 0;
+        std::size_t dead = 0;
+        std::size_t eta = 0;
+
+        std::size_t total() const
+        {
+            return inlined + folded + dead + eta;
+        }
+
+        void report(std::ostream &os) const
+        {
+            os << "simplified: " << inlined << " inlined, " << folded << " folded, " << dead << " dead bindings, " << eta << " eta" << std::endl;
+        }
+    };
+
+    bool enabled(const Options &options)
+    {
+        return options.inline_definitions || options.fold || options.dead || options.eta;
+    }
+
+    // "on" (inline, fold and dead), "off", or a comma separated list of passes
+    bool parse_passes(std::string_view str, Options &options)
+    {
+        Options res;
+        res.inline_size = options.inline_size;
+        if (str == "on")
+        {
+            res.inline_definitions = res.fold = res.dead = true;
+        }
+        else if (str != "off")
+        {
+            while (!str.empty())
+            {
+                auto end = str.find(',');
+                auto pass = str.substr(0, end);
+                if (pass == "inline")
+                    res.inline_definitions = true;
+                else if (pass == "fold")
+                    res.fold = true;
+                else if (pass == "dead")
+                    res.dead = true;
+                else if (pass == "eta")
+                    res.eta = true;
+                else
+                    return false;
+                str = (end == std::string_view::npos) ? "" : str.substr(end + 1);
+            }
+        }
+        options = res;
+        return true;
+    }
+
+    namespace impl
+    {
+        std::size_t size(const Expression &exp)
+        {
+            switch (exp.kind())
+            {
+            case Expression::Kind::abstraction:
+                return 1 + size(exp.body());
+            case Expression::Kind::application:
+                return 1 + size(exp.function()) + size(exp.argument());
+            default:
+                return 1;
+            }
+        }
+
+        bool bound(const std::string &name, const std::vector<std::string> &scope)
+        {
+            for (auto &&s : scope)
+            {
+                if (s == name)
+                    return true;
+            }
+            return false;
+        }
+
+        void count(const Expression &exp, const Environment &env, std::vector<std::string> &scope, std::map<std::string, std::size_t> &uses)
+        {
+            switch (exp.kind())
+            {
+            case Expression::Kind::abstraction:
+                scope.push_back(exp.symbol());
+                count(exp.body(), env, scope, uses);
+                scope.pop_back();
+                break;
+            case Expression::Kind::application:
+                count(exp.function(), env, scope, uses);
+                count(exp.argument(), env, scope, uses);
+                break;
+            default:
+                if ((exp.kind() == Expression::Kind::constant || !bound(exp.symbol(), scope)) && env.find(exp.symbol()))
+                    uses[exp.symbol()]++;
+                break;
+            }
+        }
+
+        // every name free in exp, constants included, which free_variables() leaves out
+        void free_names(const Expression &exp, std::vector<std::string> &scope, std::set<std::string> &names)
+        {
+            switch (exp.kind())
+            {
+            case Expression::Kind::abstraction:
+                scope.push_back(exp.symbol());
+                free_names(exp.body(), scope, names);
+                scope.pop_back();
+                break;
+            case Expression::Kind::application:
+                free_names(exp.function(), scope, names);
+                free_names(exp.argument(), scope, names);
+                break;
+            default:
+                if (exp.kind() == Expression::Kind::constant || !bound(exp.symbol(), scope))
+                    names.insert(exp.symbol());
+                break;
+            }
+        }
+
+        class Simplifier
+        {
+        public:
+            Simplifier(const Environment &env, const Options &options, Stats &stats) : env(env), options(options), stats(stats) {}
+
+            Expression run(const Expression &exp)
+            {
+                if (options.inline_definitions)
+                {
+                    std::vector<std::string> scope;
+                    count(exp, env, scope, uses);
+                }
+                std::vector<std::string> scope;
+                return simplify(exp, scope);
+            }
+
+        private:
+            const Environment &env;
+            const Options &options;
+            Stats &stats;
+            std::map<std::string, std::size_t> uses;
+
+            static bool is_identity(const Expression &exp)
+            {
+                return exp.kind() == Expression::Kind::abstraction && exp.body().kind() == Expression::Kind::variable && exp.body().symbol() == exp.symbol();
+            }
+
+            static bool is_constant_function(const Expression &exp)
+            {
+                if (exp.kind() != Expression::Kind::abstraction || exp.body().kind() != Expression::Kind::abstraction)
+                    return false;
+                auto &inner = exp.body();
+                return inner.symbol() != exp.symbol() && inner.body().kind() == Expression::Kind::variable && inner.body().symbol() == exp.symbol();
+            }
+
+            // the body of the definition name if it may replace the name here
+            const Expression *inlinable(const std::string &name, const std::vector<std::string> &scope)
+            {
+                auto def = env.find(name);
+                if (!def)
+                    return nullptr;
+                if (uses[name] > 1 && size(def->exp) > options.inline_size)
+                    return nullptr;
+                // bodies mentioning other definitions or names bound here are left to evaluate()
+                std::vector<std::string> inner;
+                std::set<std::string> names;
+                free_names(def->exp, inner, names);
+                for (auto &&v : names)
+                {
+                    if (env.find(v) || bound(v, scope))
+                        return nullptr;
+                }
+                return &def->exp;
+            }
+
+            Expression simplify(const Expression &exp, std::vector<std::string> &scope)
+            {
+                switch (exp.kind())
+                {
+                case Expression::Kind::abstraction:
+                {
+                    scope.push_back(exp.symbol());
+                    auto body = simplify(exp.body(), scope);
+                    scope.pop_back();
+                    if (options.eta && body.kind() == Expression::Kind::application && body.argument().kind() == Expression::Kind::variable &&
+                        body.argument().symbol() == exp.symbol() && !body.function().free_variables().contains(exp.symbol()))
+                    {
+                        stats.eta++;
+                        return body.function();
+                    }
+                    if (body.identical(exp.body()))
+                        return exp;
+                    return Expression(exp.symbol(), body, exp.origin());
+                }
+                case Expression::Kind::application:
+                {
+                    auto f = simplify(exp.function(), scope);
+                    auto a = simplify(exp.argument(), scope);
+                    if (options.fold && is_identity(f))
+                    {
+                        stats.folded++;
+                        return a;
+                    }
+                    if (options.fold && f.kind() == Expression::Kind::application && is_constant_function(f.function()))
+                    {
+                        stats.folded++;
+                        return f.argument();
+                    }
+                    if (options.dead && f.kind() == Expression::Kind::abstraction && !f.body().free_variables().contains(f.symbol()))
+                    {
+                        stats.dead++;
+                        return f.body();
+                    }
+                    if (f.identical(exp.function()) && a.identical(exp.argument()))
+                        return exp;
+                    return Expression(f, a);
+                }
+                default:
+                {
+                    if (!options.inline_definitions || (exp.kind() == Expression::Kind::variable && bound(exp.symbol(), scope)))
+                        return exp;
+                    auto body = inlinable(exp.symbol(), scope);
+                    if (!body)
+                        return exp;
+                    stats.inlined++;
+                    return *body;
+                }
+                }
+            }
+        };
+    }
+
+    Expression run(const Expression &exp, const Environment &env, const Options &options, Stats &stats)
+    {
+        if (!enabled(options))
+            return exp;
+        return impl::Simplifier(env, options, stats).run(exp);
+    }
+}
+
+#endif
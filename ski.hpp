@@ -0,0 +1,380 @@
+#ifndef INCLUDED_SKI_HPP
+#define INCLUDED_SKI_HPP
+
+#include "lambda.hpp"
+#include "reducer.hpp"
+#include <cstdint>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Combinator graph reduction.
+// Terms are translated by bracket abstraction into S, K, I, B and C (Turner's
+// optimizations without the eta rule, so normal forms are not eta-reduced) and
+// reduced lazily on a graph whose redex roots are overwritten by their results,
+// so shared subterms are reduced once. Normal forms are read back by applying
+// unsaturated combinators to fresh variables.
+namespace ski
+{
+    enum class Tag : std::uint32_t
+    {
+        application, // lhs: function, rhs: argument
+        combinator,  // lhs: Combinator, rhs: symbol of the binder it abstracts
+        atom,        // lhs: symbol, rhs: 1 for a constant
+        variable,    // lhs: symbol, only while abstracting
+        level,       // lhs: fresh variable of the read-back
+        indirection  // lhs: node this one was reduced to
+    };
+
+    enum Combinator : std::uint32_t
+    {
+        S,
+        K,
+        I,
+        B,
+        C
+    };
+
+    struct Node
+    {
+        Tag tag;
+        std::uint32_t lhs;
+        std::uint32_t rhs;
+    };
+
+    // a graph owns its nodes; use one per thread
+    class Graph
+    {
+    public:
+        Graph();
+
+        // evaluates exp to normal form, resolving free names against env
+        Expression normalize(const Expression &exp, const Environment &env);
+
+    private:
+        // unresolved: names compiled as free because they were not defined
+        // yet, including those of the globals it refers to
+        struct Global
+        {
+            Expression source;
+            std::uint32_t node;
+            std::set<std::string> unresolved;
+        };
+
+        std::vector<Node> nodes;
+        std::vector<std::string> symbols;
+        std::map<std::string, std::uint32_t> symbol_ids;
+        std::set<std::string> constants;
+        std::map<std::string, Global> globals;
+        std::vector<std::set<std::string>> unresolved; // of the globals being compiled, innermost last
+
+        // nodes below the mark belong to globals and survive between lines;
+        // they are never overwritten, so they never point above the mark
+        std::size_t mark;
+
+        std::uint32_t intern(const std::string &name);
+        std::uint32_t make(Tag tag, std::uint32_t lhs, std::uint32_t rhs);
+        std::uint32_t apply(std::uint32_t f, std::uint32_t a);
+        std::uint32_t global(const std::string &name, const Environment &env);
+        void prepare(const Expression &exp, std::vector<std::string> &scope, const Environment &env, const std::string &owner);
+        std::uint32_t compile(const Expression &exp, std::vector<std::string> &scope, const Environment &env, const std::string &owner);
+        bool contains(std::uint32_t exp, std::uint32_t symbol) const;
+        std::uint32_t abstract(std::uint32_t symbol, std::uint32_t exp);
+
+        std::uint32_t whnf(std::uint32_t exp, std::vector<std::uint32_t> &args);
+        Expression readback(std::uint32_t exp, std::vector<std::string> &names);
+        std::string fresh(const std::string &hint, const std::vector<std::string> &names) const;
+    };
+
+    std::uint32_t arity(std::uint32_t c)
+    {
+        switch (c)
+        {
+        case I:
+            return 1;
+        case K:
+            return 2;
+        default:
+            return 3;
+        }
+    }
+
+    Graph::Graph() : mark(0)
+    {
+    }
+
+    std::uint32_t Graph::intern(const std::string &name)
+    {
+        auto it = symbol_ids.find(name);
+        if (it != symbol_ids.end())
+            return it->second;
+        symbols.push_back(name);
+        symbol_ids.emplace(name, symbols.size() - 1);
+        return symbols.size() - 1;
+    }
+
+    std::uint32_t Graph::make(Tag tag, std::uint32_t lhs, std::uint32_t rhs)
+    {
+        if (nodes.size() == 0xffffffffu)
+            throw std::length_error("ski: out of node indices");
+        nodes.push_back({tag, lhs, rhs});
+        return nodes.size() - 1;
+    }
+
+    std::uint32_t Graph::apply(std::uint32_t f, std::uint32_t a)
+    {
+        return make(Tag::application, f, a);
+    }
+
+    std::uint32_t Graph::global(const std::string &name, const Environment &env)
+    {
+        auto def = env.find(name);
+        auto it = globals.find(name);
+        // a global is compiled again once a name it left free has been defined
+        if (it != globals.end() && it->second.source.identical(def->exp) && !env.defines_any(it->second.unresolved))
+            return it->second.node;
+
+        unresolved.emplace_back();
+        std::vector<std::string> scope;
+        prepare(def->exp, scope, env, name);
+        auto node = compile(def->exp, scope, env, name);
+        auto names = std::move(unresolved.back());
+        unresolved.pop_back();
+
+        mark = nodes.size();
+        globals.insert_or_assign(name, Global{def->exp, node, std::move(names)});
+        return node;
+    }
+
+    void Graph::prepare(const Expression &exp, std::vector<std::string> &scope, const Environment &env, const std::string &owner)
+    {
+        switch (exp.kind())
+        {
+        case Expression::Kind::variable:
+        case Expression::Kind::constant:
+            for (auto &&name : scope)
+            {
+                if (exp.kind() == Expression::Kind::variable && name == exp.symbol())
+                    return;
+            }
+            if (env.resolve(exp.symbol(), owner))
+                global(exp.symbol(), env);
+            break;
+        case Expression::Kind::abstraction:
+            scope.push_back(exp.symbol());
+            prepare(exp.body(), scope, env, owner);
+            scope.pop_back();
+            break;
+        case Expression::Kind::application:
+            prepare(exp.function(), scope, env, owner);
+            prepare(exp.argument(), scope, env, owner);
+            break;
+        }
+    }
+
+    std::uint32_t Graph::compile(const Expression &exp, std::vector<std::string> &scope, const Environment &env, const std::string &owner)
+    {
+        switch (exp.kind())
+        {
+        case Expression::Kind::abstraction:
+        {
+            scope.push_back(exp.symbol());
+            auto body = compile(exp.body(), scope, env, owner);
+            scope.pop_back();
+            return abstract(intern(exp.symbol()), body);
+        }
+        case Expression::Kind::application:
+        {
+            auto f = compile(exp.function(), scope, env, owner);
+            return apply(f, compile(exp.argument(), scope, env, owner));
+        }
+        default:
+            break;
+        }
+
+        bool is_constant = (exp.kind() == Expression::Kind::constant);
+        for (std::size_t i = scope.size(); i > 0 && !is_constant; i--)
+        {
+            if (scope.at(i - 1) == exp.symbol())
+                return make(Tag::variable, intern(exp.symbol()), 0);
+        }
+        if (env.resolve(exp.symbol(), owner))
+        {
+            auto node = global(exp.symbol(), env);
+            if (!unresolved.empty())
+                unresolved.back().insert(globals.at(exp.symbol()).unresolved.begin(), globals.at(exp.symbol()).unresolved.end());
+            return node;
+        }
+        if (!unresolved.empty() && owner < exp.symbol())
+            unresolved.back().insert(exp.symbol());
+        constants.insert(exp.symbol());
+        return make(Tag::atom, intern(exp.symbol()), is_constant);
+    }
+
+    bool Graph::contains(std::uint32_t exp, std::uint32_t symbol) const
+    {
+        // globals are closed
+        if (exp < mark)
+            return false;
+        auto n = nodes[exp];
+        if (n.tag == Tag::variable)
+            return n.lhs == symbol;
+        if (n.tag == Tag::application)
+            return contains(n.lhs, symbol) || contains(n.rhs, symbol);
+        return false;
+    }
+
+    // [x] exp, with x given by its symbol
+    std::uint32_t Graph::abstract(std::uint32_t symbol, std::uint32_t exp)
+    {
+        auto n = nodes[exp];
+        if (n.tag == Tag::variable && n.lhs == symbol)
+            return make(Tag::combinator, I, symbol);
+        if (!contains(exp, symbol))
+            return apply(make(Tag::combinator, K, symbol), exp);
+
+        // exp is an application mentioning x
+        bool in_f = contains(n.lhs, symbol), in_a = contains(n.rhs, symbol);
+        if (in_f && in_a)
+        {
+            auto f = abstract(symbol, n.lhs);
+            return apply(apply(make(Tag::combinator, S, symbol), f), abstract(symbol, n.rhs));
+        }
+        if (in_f)
+            return apply(apply(make(Tag::combinator, C, symbol), abstract(symbol, n.lhs)), n.rhs);
+        return apply(apply(make(Tag::combinator, B, symbol), n.lhs), abstract(symbol, n.rhs));
+    }
+
+    // reduces exp to weak head normal form, returns its head and stores the
+    // arguments of the head in args, first argument first
+    std::uint32_t Graph::whnf(std::uint32_t exp, std::vector<std::uint32_t> &args)
+    {
+        std::vector<std::uint32_t> spine;
+        while (1)
+        {
+            auto n = nodes[exp];
+            if (n.tag == Tag::indirection)
+            {
+                exp = n.lhs;
+                continue;
+            }
+            if (n.tag == Tag::application)
+            {
+                spine.push_back(exp);
+                exp = n.lhs;
+                continue;
+            }
+            if (n.tag != Tag::combinator || spine.size() < arity(n.lhs))
+                break;
+
+            control::step();
+            auto k = arity(n.lhs);
+            auto arg = [&](std::uint32_t i)
+            {
+                return nodes[spine[spine.size() - 1 - i]].rhs;
+            };
+            auto root = spine[spine.size() - k];
+            Node res;
+            switch (n.lhs)
+            {
+            case I:
+            case K:
+                res = {Tag::indirection, arg(0), 0};
+                break;
+            case S:
+            {
+                auto f = apply(arg(0), arg(2));
+                res = {Tag::application, f, apply(arg(1), arg(2))};
+                break;
+            }
+            case B:
+                res = {Tag::application, arg(0), apply(arg(1), arg(2))};
+                break;
+            default:
+                res = {Tag::application, apply(arg(0), arg(2)), arg(1)};
+                break;
+            }
+            spine.resize(spine.size() - k);
+
+            if (root >= mark)
+            {
+                nodes[root] = res;
+                exp = root;
+            }
+            else
+            {
+                exp = (res.tag == Tag::indirection) ? res.lhs : make(res.tag, res.lhs, res.rhs);
+            }
+        }
+        for (std::size_t i = spine.size(); i > 0; i--)
+        {
+            args.push_back(nodes[spine[i - 1]].rhs);
+        }
+        return exp;
+    }
+
+    Expression Graph::readback(std::uint32_t exp, std::vector<std::string> &names)
+    {
+        std::vector<std::uint32_t> args;
+        auto head = whnf(exp, args);
+        auto n = nodes[head];
+        if (n.tag == Tag::combinator)
+        {
+            // an unsaturated combinator is a function: apply it to a fresh variable
+            auto level = static_cast<std::uint32_t>(names.size());
+            names.push_back(fresh(symbols.at(n.rhs), names));
+            auto app = head;
+            for (auto &&a : args)
+            {
+                app = apply(app, a);
+            }
+            auto body = readback(apply(app, make(Tag::level, level, 0)), names);
+            auto res = Expression(names.back(), body);
+            names.pop_back();
+            return res;
+        }
+
+        auto res = (n.tag == Tag::level) ? Expression(names.at(n.lhs)) : Expression(symbols.at(n.lhs), n.rhs != 0);
+        for (auto &&a : args)
+        {
+            res = Expression(res, readback(a, names));
+        }
+        return res;
+    }
+
+    std::string Graph::fresh(const std::string &hint, const std::vector<std::string> &names) const
+    {
+        auto used = [&](const std::string &name)
+        {
+            for (auto &&n : names)
+            {
+                if (n == name)
+                    return true;
+            }
+            return constants.contains(name);
+        };
+        auto res = hint;
+        while (used(res))
+        {
+            char c = impl::next_letter(res.at(0));
+            if (c == hint.at(0))
+                res += "'";
+            res.at(0) = c;
+        }
+        return res;
+    }
+
+    Expression Graph::normalize(const Expression &exp, const Environment &env)
+    {
+        std::vector<std::string> scope, names;
+        nodes.resize(mark);
+        prepare(exp, scope, env, "");
+        auto res = readback(compile(exp, scope, env, ""), names);
+        nodes.resize(mark);
+        return res;
+    }
+}
+
+#endif
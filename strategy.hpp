@@ -0,0 +1,254 @@
+#ifndef INCLUDED_STRATEGY_HPP
+#define INCLUDED_STRATEGY_HPP
+
+#include "cycle.hpp"
+#include "lambda.hpp"
+#include "reducer.hpp"
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class Strategy
+{
+    parallel,    // contract every redex of a pass, repeat until the term stops changing
+    normal,      // leftmost outermost redex first, to normal form
+    applicative, // arguments before the application, to normal form
+    whnf,        // call-by-name, stops at an abstraction or a variable head
+    hnf          // like whnf, but also reduces under the leading abstractions
+};
+
+bool parse_strategy(std::string_view name, Strategy &strategy)
+{
+    if (name == "parallel")
+        strategy = Strategy::parallel;
+    else if (name == "normal")
+        strategy = Strategy::normal;
+    else if (name == "applicative")
+        strategy = Strategy::applicative;
+    else if (name == "whnf")
+        strategy = Strategy::whnf;
+    else if (name == "hnf")
+        strategy = Strategy::hnf;
+    else
+        return false;
+    return true;
+}
+
+Expression rebuild(Expression exp, const std::vector<Expression> &args)
+{
+    for (std::size_t i = args.size(); i > 0; i--)
+    {
+        exp = Expression(exp, args.at(i - 1));
+    }
+    return exp;
+}
+
+Expression weak_head_normal_form(Expression exp, bool detect = false)
+{
+    CycleDetector cycles;
+    std::vector<Expression> args;
+    while (1)
+    {
+        if (exp.kind() == Expression::Kind::application)
+        {
+            args.push_back(exp.argument());
+            exp = Expression(exp.function());
+        }
+        else if (exp.kind() == Expression::Kind::abstraction && !args.empty())
+        {
+            exp = std::move(exp).apply(args.back());
+            args.pop_back();
+            if (detect)
+                cycles.observe(rebuild(exp, args));
+        }
+        else
+        {
+            break;
+        }
+    }
+    return rebuild(std::move(exp), args);
+}
+
+Expression head_normal_form(Expression exp, bool detect = false)
+{
+    // the leading abstractions, outermost first
+    std::vector<Expression> binders;
+    while (!exp.is_normal())
+    {
+        exp = weak_head_normal_form(std::move(exp), detect);
+        if (exp.kind() != Expression::Kind::abstraction)
+            break;
+        auto body = exp.body();
+        binders.push_back(std::move(exp));
+        exp = std::move(body);
+    }
+    for (std::size_t i = binders.size(); i > 0; i--)
+    {
+        exp = Expression(binders.at(i - 1).symbol(), exp, binders.at(i - 1).origin());
+    }
+    return exp;
+}
+
+// iterative, as terms such as the body of the Y combinator keep unfolding
+// under their head variable
+Expression normal_form(Expression exp, bool detect = false)
+{
+    // an abstraction waiting for its body, or an application with a normal
+    // head waiting for its function and then, with function set, its argument
+    struct Frame
+    {
+        Expression exp;
+        std::optional<Expression> function;
+    };
+    std::vector<Frame> stack;
+    while (1)
+    {
+        if (!exp.is_normal())
+        {
+            exp = weak_head_normal_form(std::move(exp), detect);
+            if (exp.kind() == Expression::Kind::abstraction || exp.kind() == Expression::Kind::application)
+            {
+                auto child = (exp.kind() == Expression::Kind::abstraction) ? exp.body() : exp.function();
+                stack.push_back({std::move(exp), std::nullopt});
+                exp = std::move(child);
+                continue;
+            }
+        }
+
+        // exp is normal: hand it to the frames waiting for it
+        while (1)
+        {
+            if (stack.empty())
+                return exp;
+            auto &frame = stack.back();
+            if (frame.exp.kind() == Expression::Kind::abstraction)
+            {
+                exp = Expression(frame.exp.symbol(), exp, frame.exp.origin());
+                stack.pop_back();
+                continue;
+            }
+            if (!frame.function)
+            {
+                frame.function = std::move(exp);
+                exp = frame.exp.argument();
+                break;
+            }
+            exp = Expression(*frame.function, exp);
+            stack.pop_back();
+        }
+    }
+}
+
+// iterative, so terms that keep growing do not overflow the stack; every
+// application being normalized watches its own sequence of contractions
+Expression applicative_normal_form(Expression exp, bool detect = false)
+{
+    // an abstraction waiting for its body, or an application waiting for its
+    // function and then, with function set, for its argument
+    struct Frame
+    {
+        Expression exp;
+        std::optional<Expression> function;
+        CycleDetector cycles;
+    };
+    std::vector<Frame> stack;
+    CycleDetector cycles;
+    while (1)
+    {
+        if (!exp.is_normal())
+        {
+            auto child = (exp.kind() == Expression::Kind::abstraction) ? exp.body() : exp.function();
+            stack.push_back({std::move(exp), std::nullopt, std::move(cycles)});
+            cycles = CycleDetector();
+            exp = std::move(child);
+            continue;
+        }
+
+        // exp is normal: hand it to the frames waiting for it
+        while (1)
+        {
+            if (stack.empty())
+                return exp;
+            auto &frame = stack.back();
+            if (frame.exp.kind() == Expression::Kind::abstraction)
+            {
+                exp = Expression(frame.exp.symbol(), exp, frame.exp.origin());
+                stack.pop_back();
+                continue;
+            }
+            if (!frame.function)
+            {
+                frame.function = std::move(exp);
+                cycles = CycleDetector();
+                exp = frame.exp.argument();
+                break;
+            }
+            auto f = std::move(*frame.function);
+            cycles = std::move(frame.cycles);
+            stack.pop_back();
+            if (f.kind() != Expression::Kind::abstraction)
+            {
+                exp = Expression(f, exp);
+                continue;
+            }
+            exp = std::move(f).apply(exp);
+            if (detect)
+                cycles.observe(exp);
+            break;
+        }
+    }
+}
+
+// stops as soon as no redex is left; otherwise when a pass reproduces its input
+Expression parallel_normal_form(Expression exp, bool detect = false)
+{
+    CycleDetector cycles;
+    if (exp.is_normal())
+        return exp;
+    auto prev = exp.str();
+    while (1)
+    {
+        exp = std::move(exp).beta_reduction();
+        if (exp.is_normal())
+            return exp;
+        auto cur = exp.str();
+        if (cur == prev)
+            break;
+        if (detect)
+            cycles.observe(exp);
+        prev = std::move(cur);
+    }
+    // a pass that reproduces a term with redexes left is a cycle of period one
+    if (detect && has_redex(exp))
+        throw DivergenceException(1);
+    return exp;
+}
+
+// inlines the definitions of env into exp and reduces it with strategy;
+// with detect, every strategy watches its own reduction sequence for repeated
+// states and throws DivergenceException on the first one
+Expression evaluate(const Expression &exp, const Environment &env, Strategy strategy = Strategy::parallel, bool detect = false)
+{
+    auto l = exp;
+    for (auto &&def : env)
+    {
+        l = std::move(l).substitute(def.name, def.exp);
+    }
+
+    switch (strategy)
+    {
+    case Strategy::normal:
+        return normal_form(std::move(l), detect);
+    case Strategy::applicative:
+        return applicative_normal_form(std::move(l), detect);
+    case Strategy::whnf:
+        return weak_head_normal_form(std::move(l), detect);
+    case Strategy::hnf:
+        return head_normal_form(std::move(l), detect);
+    default:
+        return parallel_normal_form(std::move(l), detect);
+    }
+}
+
+#endif
@@ -0,0 +1,19 @@
+// Checked by the compiler alone: run.sh builds it with -fsyntax-only, then
+// once with each of -DNEGATIVE_DEFINITION and -DNEGATIVE_CHARACTER, which
+// must fail to compile.
+#include "../compiletime.hpp"
+
+static_assert(ct::term<"(\\x.x) a">::size == 4);
+static_assert(ct::term<"\\x.\n\tx  y">::size == 4);
+static_assert(ct::normal<"(\\x.x) a">::size == 1);
+static_assert(ct::normal<"(\\x.\\y.x) a b">::table.steps == 2);
+
+#ifdef NEGATIVE_DEFINITION
+// ct: definitions are not terms
+static_assert(ct::term<"id = \\x.x">::size > 0);
+#endif
+
+#ifdef NEGATIVE_CHARACTER
+// ct: unexpected character
+static_assert(ct::term<"\\x.x; y">::size > 0);
+#endif
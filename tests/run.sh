@@ -0,0 +1,55 @@
+#!/bin/sh
+# Runs every tests/*.ln once for each "#run <options>" line it contains and
+# compares the output, followed by the exit status, with tests/<name>.out.
+# Runs are cut after $TIMEOUT seconds, so diverging terms end with "exit 124".
+set -u
+cd "$(dirname "$0")/.."
+CXX=${CXX:-g++}
+TIMEOUT=${TIMEOUT:-2}
+bin=$(mktemp -d)
+trap 'rm -rf "$bin"' EXIT
+
+$CXX -std=c++20 -O2 -pthread -o "$bin/lambda" lambda.cpp || exit 1
+
+failed=0
+for t in tests/*.ln; do
+    grep '^#run' "$t" | sed 's/^#run *//' > "$bin/runs"
+    while IFS= read -r options; do
+        # options are split into words on purpose
+        timeout "$TIMEOUT" "$bin/lambda" $options "$t" > "$bin/out" 2> /dev/null
+        echo "exit $?" >> "$bin/out"
+        if ! diff -u "${t%.ln}.out" "$bin/out"; then
+            echo "FAIL: $t $options"
+            failed=1
+        fi
+    done < "$bin/runs"
+done
+
+# the program emitted for a script builds without warnings and prints the same
+"$bin/lambda" --emit-cpp="$bin/forward.cpp" tests/forward.ln
+if ! $CXX -std=c++20 -Wall -Wextra -Werror -o "$bin/forward" "$bin/forward.cpp"; then
+    echo "FAIL: tests/forward.ln --emit-cpp"
+    failed=1
+else
+    timeout "$TIMEOUT" "$bin/forward" > "$bin/out"
+    echo "exit $?" >> "$bin/out"
+    if ! diff -u tests/forward.out "$bin/out"; then
+        echo "FAIL: tests/forward.ln --emit-cpp"
+        failed=1
+    fi
+fi
+
+# term literals are checked at compile time; the negative cases must be rejected
+if ! $CXX -std=c++20 -fsyntax-only tests/compiletime.cpp; then
+    echo "FAIL: tests/compiletime.cpp"
+    failed=1
+fi
+for negative in "NEGATIVE_DEFINITION definitions are not terms" "NEGATIVE_CHARACTER unexpected character"; do
+    if ! $CXX -std=c++20 -fsyntax-only -D"${negative%% *}" tests/compiletime.cpp 2>&1 | grep -q "ct: ${negative#* }"; then
+        echo "FAIL: tests/compiletime.cpp -D${negative%% *}"
+        failed=1
+    fi
+done
+
+[ "$failed" = 0 ] && echo "all tests passed"
+exit "$failed"
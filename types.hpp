@@ -0,0 +1,282 @@
+#ifndef INCLUDED_TYPES_HPP
+#define INCLUDED_TYPES_HPP
+
+#include "lambda.hpp"
+#include "reducer.hpp"
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Hindley-Milner inference of simple types.
+// A term that has a type is strongly normalizing, so every evaluation order
+// terminates on it. Names defined in the environment are typed once, generalized
+// and instantiated at each use; other free names are inert and get a fresh type
+// at every occurrence. Definitions are resolved transitively, as if all of them
+// were inlined: if that term terminates, so does any partially inlined one.
+namespace types
+{
+    class Checker
+    {
+    public:
+        // principal type of exp, "a -> b -> a" style, or nothing when it has no simple type
+        std::optional<std::string> infer(const Expression &exp, const Environment &env);
+
+        bool typeable(const Expression &exp, const Environment &env);
+
+    private:
+        // a type variable linked to lhs (itself while unbound), or an arrow lhs -> rhs
+        struct Node
+        {
+            bool arrow;
+            std::uint32_t lhs;
+            std::uint32_t rhs;
+        };
+
+        // type of a definition with every variable quantified, numbered locally;
+        // unresolved: free names that were not defined yet, including those of
+        // the definitions it refers to
+        struct Scheme
+        {
+            Expression source;
+            bool typeable;
+            std::vector<Node> nodes;
+            std::uint32_t root;
+            std::set<std::string> unresolved;
+        };
+
+        struct Mismatch
+        {
+        };
+
+        std::vector<Node> nodes;
+        std::map<std::string, Scheme> schemes;
+        std::vector<std::set<std::string>> unresolved; // of the definitions being inferred, innermost last
+
+        std::uint32_t variable();
+        std::uint32_t arrow(std::uint32_t from, std::uint32_t to);
+        std::uint32_t find(std::uint32_t t);
+        bool occurs(std::uint32_t v, std::uint32_t t);
+        void unify(std::uint32_t a, std::uint32_t b);
+
+        std::uint32_t infer(const Expression &exp, std::vector<std::pair<std::string, std::uint32_t>> &scope, const Environment &env, std::set<std::string> &expanding);
+        std::uint32_t global(const std::string &name, const Environment &env, std::set<std::string> &expanding);
+
+        std::uint32_t extract(std::uint32_t t, std::vector<Node> &out, std::map<std::uint32_t, std::uint32_t> &vars);
+        std::uint32_t instantiate(const Scheme &scheme, std::uint32_t t, std::map<std::uint32_t, std::uint32_t> &vars);
+        std::string str(std::uint32_t t, std::map<std::uint32_t, std::string> &names, bool left);
+    };
+
+    std::uint32_t Checker::variable()
+    {
+        nodes.push_back({false, static_cast<std::uint32_t>(nodes.size()), 0});
+        return nodes.size() - 1;
+    }
+
+    std::uint32_t Checker::arrow(std::uint32_t from, std::uint32_t to)
+    {
+        nodes.push_back({true, from, to});
+        return nodes.size() - 1;
+    }
+
+    std::uint32_t Checker::find(std::uint32_t t)
+    {
+        while (!nodes[t].arrow && nodes[t].lhs != t)
+        {
+            // path halving
+            auto next = nodes[t].lhs;
+            if (!nodes[next].arrow)
+                nodes[t].lhs = nodes[next].lhs;
+            t = next;
+        }
+        return t;
+    }
+
+    bool Checker::occurs(std::uint32_t v, std::uint32_t t)
+    {
+        t = find(t);
+        if (!nodes[t].arrow)
+            return t == v;
+        auto n = nodes[t];
+        return occurs(v, n.lhs) || occurs(v, n.rhs);
+    }
+
+    void Checker::unify(std::uint32_t a, std::uint32_t b)
+    {
+        a = find(a);
+        b = find(b);
+        if (a == b)
+            return;
+        if (!nodes[a].arrow || !nodes[b].arrow)
+        {
+            if (nodes[a].arrow)
+                std::swap(a, b);
+            if (occurs(a, b))
+                throw Mismatch();
+            nodes[a].lhs = b;
+            return;
+        }
+        auto x = nodes[a], y = nodes[b];
+        unify(x.lhs, y.lhs);
+        unify(x.rhs, y.rhs);
+    }
+
+    std::uint32_t Checker::infer(const Expression &exp, std::vector<std::pair<std::string, std::uint32_t>> &scope, const Environment &env, std::set<std::string> &expanding)
+    {
+        switch (exp.kind())
+        {
+        case Expression::Kind::abstraction:
+        {
+            auto v = variable();
+            scope.emplace_back(exp.symbol(), v);
+            auto body = infer(exp.body(), scope, env, expanding);
+            scope.pop_back();
+            return arrow(v, body);
+        }
+        case Expression::Kind::application:
+        {
+            auto f = infer(exp.function(), scope, env, expanding);
+            auto a = infer(exp.argument(), scope, env, expanding);
+            auto r = variable();
+            unify(f, arrow(a, r));
+            return r;
+        }
+        case Expression::Kind::variable:
+            for (std::size_t i = scope.size(); i > 0; i--)
+            {
+                if (scope.at(i - 1).first == exp.symbol())
+                    return scope.at(i - 1).second;
+            }
+            break;
+        default:
+            break;
+        }
+
+        if (!env.find(exp.symbol()))
+        {
+            if (!unresolved.empty())
+                unresolved.back().insert(exp.symbol());
+            return variable();
+        }
+        // definitions referring back to themselves are left to the general reducer
+        if (expanding.contains(exp.symbol()))
+            throw Mismatch();
+        return global(exp.symbol(), env, expanding);
+    }
+
+    std::uint32_t Checker::global(const std::string &name, const Environment &env, std::set<std::string> &expanding)
+    {
+        auto def = env.find(name);
+        auto it = schemes.find(name);
+        // a scheme is inferred again once a name it left free has been defined
+        if (it == schemes.end() || !it->second.source.identical(def->exp) || env.defines_any(it->second.unresolved))
+        {
+            Scheme scheme{def->exp, false, {}, 0, {}};
+            expanding.insert(name);
+            unresolved.emplace_back();
+            try
+            {
+                std::vector<std::pair<std::string, std::uint32_t>> scope;
+                auto t = infer(def->exp, scope, env, expanding);
+                std::map<std::uint32_t, std::uint32_t> vars;
+                scheme.root = extract(t, scheme.nodes, vars);
+                scheme.typeable = true;
+            }
+            catch (const Mismatch &)
+            {
+            }
+            expanding.erase(name);
+            scheme.unresolved = std::move(unresolved.back());
+            unresolved.pop_back();
+            it = schemes.insert_or_assign(name, std::move(scheme)).first;
+        }
+        if (!unresolved.empty())
+            unresolved.back().insert(it->second.unresolved.begin(), it->second.unresolved.end());
+        if (!it->second.typeable)
+            throw Mismatch();
+        std::map<std::uint32_t, std::uint32_t> vars;
+        return instantiate(it->second, it->second.root, vars);
+    }
+
+    std::uint32_t Checker::extract(std::uint32_t t, std::vector<Node> &out, std::map<std::uint32_t, std::uint32_t> &vars)
+    {
+        t = find(t);
+        auto n = nodes[t];
+        if (n.arrow)
+        {
+            auto from = extract(n.lhs, out, vars);
+            auto to = extract(n.rhs, out, vars);
+            out.push_back({true, from, to});
+            return out.size() - 1;
+        }
+        auto it = vars.find(t);
+        if (it != vars.end())
+            return it->second;
+        out.push_back({false, static_cast<std::uint32_t>(out.size()), 0});
+        vars.emplace(t, out.size() - 1);
+        return out.size() - 1;
+    }
+
+    std::uint32_t Checker::instantiate(const Scheme &scheme, std::uint32_t t, std::map<std::uint32_t, std::uint32_t> &vars)
+    {
+        auto n = scheme.nodes.at(t);
+        if (n.arrow)
+        {
+            auto from = instantiate(scheme, n.lhs, vars);
+            return arrow(from, instantiate(scheme, n.rhs, vars));
+        }
+        auto it = vars.find(t);
+        if (it != vars.end())
+            return it->second;
+        auto v = variable();
+        vars.emplace(t, v);
+        return v;
+    }
+
+    std::string Checker::str(std::uint32_t t, std::map<std::uint32_t, std::string> &names, bool left)
+    {
+        t = find(t);
+        auto n = nodes[t];
+        if (n.arrow)
+        {
+            auto res = str(n.lhs, names, true) + " -> " + str(n.rhs, names, false);
+            return left ? "(" + res + ")" : res;
+        }
+        auto it = names.find(t);
+        if (it != names.end())
+            return it->second;
+        std::string name = {static_cast<char>('a' + names.size() % 26)};
+        if (names.size() >= 26)
+            name += std::to_string(names.size() / 26);
+        names.emplace(t, name);
+        return name;
+    }
+
+    std::optional<std::string> Checker::infer(const Expression &exp, const Environment &env)
+    {
+        std::optional<std::string> res;
+        std::vector<std::pair<std::string, std::uint32_t>> scope;
+        std::set<std::string> expanding;
+        try
+        {
+            auto t = infer(exp, scope, env, expanding);
+            std::map<std::uint32_t, std::string> names;
+            res = str(t, names, false);
+        }
+        catch (const Mismatch &)
+        {
+        }
+        nodes.clear();
+        return res;
+    }
+
+    bool Checker::typeable(const Expression &exp, const Environment &env)
+    {
+        return infer(exp, env).has_value();
+    }
+}
+
+#endif
@@ -0,0 +1,435 @@
+#ifndef INCLUDED_VM_HPP
+#define INCLUDED_VM_HPP
+
+#include "lambda.hpp"
+#include "reducer.hpp"
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// Lazy Krivine machine with a flat instruction array.
+// Terms are compiled to de Bruijn indexed code; arguments become thunks that
+// are updated in place once evaluated. Full normal forms are obtained by
+// reading values back under fresh variables.
+namespace vm
+{
+    enum class Op : std::uint32_t
+    {
+        access,   // enter the thunk bound at de Bruijn index operand
+        grab,     // bind the topmost argument, operand is the binder symbol
+        push,     // push a thunk for the code at address operand
+        constant, // neutral term headed by symbol operand
+        global    // enter the thunk of global operand
+    };
+
+    struct Instruction
+    {
+        Op op;
+        std::uint32_t operand;
+    };
+
+    // a machine owns mutable heaps; use one per thread
+    class Machine
+    {
+    public:
+        Machine();
+
+        // evaluates exp to normal form, resolving free names against env
+        Expression normalize(const Expression &exp, const Environment &env);
+
+    private:
+        static constexpr std::uint32_t neutral_bit = 0x80000000u;
+        static constexpr std::uint32_t update_bit = 0x80000000u;
+        static constexpr std::uint32_t level_bit = 0x80000000u;
+
+        // a suspended computation, or its value once evaluated:
+        // code points at a grab (closure) or has neutral_bit set (neutral term)
+        struct Thunk
+        {
+            std::uint32_t code;
+            std::uint32_t env;
+        };
+
+        struct Frame
+        {
+            std::uint32_t thunk;
+            std::uint32_t next;
+        };
+
+        // head is a symbol, or level_bit | level for a fresh variable
+        struct Neutral
+        {
+            std::uint32_t head;
+            std::uint32_t first;
+            std::uint32_t count;
+        };
+
+        // unresolved: names compiled as constants because they were not defined
+        // yet, including those of the globals it refers to
+        struct Global
+        {
+            Expression source;
+            std::uint32_t thunk;
+            std::set<std::string> unresolved;
+        };
+
+        std::vector<Instruction> code;
+        std::vector<Thunk> thunks;
+        std::vector<Frame> frames;
+        std::vector<Neutral> neutrals;
+        std::vector<std::uint32_t> spine;
+        std::vector<std::uint32_t> stack;
+
+        std::vector<std::string> symbols;
+        std::map<std::string, std::uint32_t> symbol_ids;
+        std::set<std::string> constants;
+
+        std::map<std::string, Global> globals;
+        std::vector<std::uint32_t> global_thunks;
+        std::vector<std::set<std::string>> unresolved; // of the globals being compiled, innermost last
+
+        // everything below the marks belongs to globals and survives between lines
+        std::size_t code_mark, thunk_mark, frame_mark, neutral_mark, spine_mark;
+
+        std::uint32_t intern(const std::string &name);
+        std::uint32_t global(const std::string &name, const Environment &env);
+        void prepare(const Expression &exp, std::vector<std::string> &scope, const Environment &env, const std::string &owner);
+        void compile(const Expression &exp, std::vector<std::string> &scope, const Environment &env, const std::string &owner);
+        void reference(const std::string &name, const Environment &env, const std::string &owner);
+
+        std::uint32_t allocate(std::uint32_t pc, std::uint32_t env);
+        std::uint32_t bind(std::uint32_t thunk, std::uint32_t env);
+        std::uint32_t lookup(std::uint32_t env, std::uint32_t index) const;
+        std::uint32_t neutral(std::uint32_t head, const std::vector<std::uint32_t> &args);
+
+        Thunk force(std::uint32_t thunk);
+        Thunk run(std::uint32_t pc, std::uint32_t env, std::size_t base);
+        Thunk spill(std::uint32_t head, std::vector<std::uint32_t> args, std::size_t base);
+
+        Expression readback(Thunk value, std::vector<std::string> &names);
+        std::string fresh(const std::string &hint, const std::vector<std::string> &names) const;
+
+        void commit();
+        void reset();
+    };
+
+    Machine::Machine()
+    {
+        frames.push_back({0, 0});
+        commit();
+    }
+
+    std::uint32_t Machine::intern(const std::string &name)
+    {
+        auto it = symbol_ids.find(name);
+        if (it != symbol_ids.end())
+            return it->second;
+        symbols.push_back(name);
+        symbol_ids.emplace(name, symbols.size() - 1);
+        return symbols.size() - 1;
+    }
+
+    std::uint32_t Machine::global(const std::string &name, const Environment &env)
+    {
+        auto def = env.find(name);
+        auto it = globals.find(name);
+        // a global is compiled again once a name it left free has been defined
+        if (it != globals.end() && it->second.source.identical(def->exp) && !env.defines_any(it->second.unresolved))
+            return it->second.thunk;
+
+        unresolved.emplace_back();
+        std::vector<std::string> scope;
+        prepare(def->exp, scope, env, name);
+        auto start = code.size();
+        compile(def->exp, scope, env, name);
+        auto names = std::move(unresolved.back());
+        unresolved.pop_back();
+
+        global_thunks.push_back(allocate(start, 0));
+        auto index = global_thunks.size() - 1;
+        force(global_thunks.back());
+        commit();
+        globals.insert_or_assign(name, Global{def->exp, static_cast<std::uint32_t>(index), std::move(names)});
+        return index;
+    }
+
+    void Machine::prepare(const Expression &exp, std::vector<std::string> &scope, const Environment &env, const std::string &owner)
+    {
+        switch (exp.kind())
+        {
+        case Expression::Kind::variable:
+        case Expression::Kind::constant:
+            for (auto &&name : scope)
+            {
+                if (exp.kind() == Expression::Kind::variable && name == exp.symbol())
+                    return;
+            }
+            if (env.resolve(exp.symbol(), owner))
+                global(exp.symbol(), env);
+            break;
+        case Expression::Kind::abstraction:
+            scope.push_back(exp.symbol());
+            prepare(exp.body(), scope, env, owner);
+            scope.pop_back();
+            break;
+        case Expression::Kind::application:
+            prepare(exp.function(), scope, env, owner);
+            prepare(exp.argument(), scope, env, owner);
+            break;
+        }
+    }
+
+    void Machine::compile(const Expression &exp, std::vector<std::string> &scope, const Environment &env, const std::string &owner)
+    {
+        std::vector<const Expression *> args;
+        const Expression *head = &exp;
+        while (head->kind() == Expression::Kind::application)
+        {
+            args.push_back(&head->argument());
+            head = &head->function();
+        }
+
+        // args holds the last argument first, so the first argument is pushed last and ends up on top
+        std::vector<std::size_t> patches;
+        for (std::size_t i = 0; i < args.size(); i++)
+        {
+            patches.push_back(code.size());
+            code.push_back({Op::push, 0});
+        }
+
+        switch (head->kind())
+        {
+        case Expression::Kind::variable:
+        {
+            bool bound = false;
+            for (std::size_t i = scope.size(); i > 0; i--)
+            {
+                if (scope.at(i - 1) == head->symbol())
+                {
+                    code.push_back({Op::access, static_cast<std::uint32_t>(scope.size() - i)});
+                    bound = true;
+                    break;
+                }
+            }
+            if (!bound)
+                reference(head->symbol(), env, owner);
+            break;
+        }
+        case Expression::Kind::constant:
+            reference(head->symbol(), env, owner);
+            break;
+        case Expression::Kind::abstraction:
+            code.push_back({Op::grab, intern(head->symbol())});
+            scope.push_back(head->symbol());
+            compile(head->body(), scope, env, owner);
+            scope.pop_back();
+            break;
+        default:
+            break;
+        }
+
+        for (std::size_t i = 0; i < args.size(); i++)
+        {
+            code.at(patches.at(i)).operand = code.size();
+            compile(*args.at(i), scope, env, owner);
+        }
+    }
+
+    void Machine::reference(const std::string &name, const Environment &env, const std::string &owner)
+    {
+        if (env.resolve(name, owner))
+        {
+            code.push_back({Op::global, global(name, env)});
+            if (!unresolved.empty())
+                unresolved.back().insert(globals.at(name).unresolved.begin(), globals.at(name).unresolved.end());
+            return;
+        }
+        if (!unresolved.empty() && owner < name)
+            unresolved.back().insert(name);
+        constants.insert(name);
+        code.push_back({Op::constant, intern(name)});
+    }
+
+    std::uint32_t Machine::allocate(std::uint32_t pc, std::uint32_t env)
+    {
+        thunks.push_back({pc, env});
+        return thunks.size() - 1;
+    }
+
+    std::uint32_t Machine::bind(std::uint32_t thunk, std::uint32_t env)
+    {
+        frames.push_back({thunk, env});
+        return frames.size() - 1;
+    }
+
+    std::uint32_t Machine::lookup(std::uint32_t env, std::uint32_t index) const
+    {
+        while (index > 0)
+        {
+            env = frames[env].next;
+            index--;
+        }
+        return frames[env].thunk;
+    }
+
+    std::uint32_t Machine::neutral(std::uint32_t head, const std::vector<std::uint32_t> &args)
+    {
+        neutrals.push_back({head, static_cast<std::uint32_t>(spine.size()), static_cast<std::uint32_t>(args.size())});
+        spine.insert(spine.end(), args.begin(), args.end());
+        return neutral_bit | static_cast<std::uint32_t>(neutrals.size() - 1);
+    }
+
+    Machine::Thunk Machine::force(std::uint32_t thunk)
+    {
+        auto t = thunks[thunk];
+        if ((t.code & neutral_bit) || code[t.code].op == Op::grab)
+            return t;
+        auto base = stack.size();
+        // thunks owned by globals may only refer to global frames, so they are never updated
+        if (thunk >= thunk_mark)
+            stack.push_back(update_bit | thunk);
+        return run(t.code, t.env, base);
+    }
+
+    Machine::Thunk Machine::run(std::uint32_t pc, std::uint32_t env, std::size_t base)
+    {
+        while (1)
+        {
+            auto ins = code[pc];
+            switch (ins.op)
+            {
+            case Op::push:
+                stack.push_back(allocate(ins.operand, env));
+                pc++;
+                break;
+            case Op::grab:
+                if (stack.size() == base)
+                    return {pc, env};
+                if (stack.back() & update_bit)
+                {
+                    thunks[stack.back() & ~update_bit] = {pc, env};
+                    stack.pop_back();
+                    break;
+                }
+                control::step();
+                env = bind(stack.back(), env);
+                stack.pop_back();
+                pc++;
+                break;
+            case Op::constant:
+                return spill(ins.operand, {}, base);
+            case Op::access:
+            case Op::global:
+            {
+                auto thunk = (ins.op == Op::access) ? lookup(env, ins.operand) : global_thunks[ins.operand];
+                auto t = thunks[thunk];
+                if (t.code & neutral_bit)
+                {
+                    auto n = neutrals[t.code & ~neutral_bit];
+                    return spill(n.head, std::vector<std::uint32_t>(spine.begin() + n.first, spine.begin() + n.first + n.count), base);
+                }
+                if (thunk >= thunk_mark && code[t.code].op != Op::grab)
+                    stack.push_back(update_bit | thunk);
+                pc = t.code;
+                env = t.env;
+                break;
+            }
+            }
+        }
+    }
+
+    // a neutral head consumes every argument up to base
+    Machine::Thunk Machine::spill(std::uint32_t head, std::vector<std::uint32_t> args, std::size_t base)
+    {
+        while (stack.size() > base)
+        {
+            auto e = stack.back();
+            stack.pop_back();
+            if (e & update_bit)
+                thunks[e & ~update_bit] = {neutral(head, args), 0};
+            else
+                args.push_back(e);
+        }
+        return {neutral(head, args), 0};
+    }
+
+    Expression Machine::readback(Thunk value, std::vector<std::string> &names)
+    {
+        if (value.code & neutral_bit)
+        {
+            auto n = neutrals[value.code & ~neutral_bit];
+            auto res = (n.head & level_bit) ? Expression(names.at(n.head & ~level_bit)) : Expression(symbols.at(n.head), true);
+            for (std::uint32_t i = 0; i < n.count; i++)
+            {
+                res = Expression(res, readback(force(spine[n.first + i]), names));
+            }
+            return res;
+        }
+
+        auto level = static_cast<std::uint32_t>(names.size());
+        names.push_back(fresh(symbols.at(code[value.code].operand), names));
+        auto var = allocate(neutral(level_bit | level, {}), 0);
+        auto body = run(value.code + 1, bind(var, value.env), stack.size());
+        auto res = Expression(names.back(), readback(body, names));
+        names.pop_back();
+        return res;
+    }
+
+    std::string Machine::fresh(const std::string &hint, const std::vector<std::string> &names) const
+    {
+        auto used = [&](const std::string &name)
+        {
+            for (auto &&n : names)
+            {
+                if (n == name)
+                    return true;
+            }
+            return constants.contains(name);
+        };
+        auto res = hint;
+        while (used(res))
+        {
+            char c = impl::next_letter(res.at(0));
+            if (c == hint.at(0))
+                res += "'";
+            res.at(0) = c;
+        }
+        return res;
+    }
+
+    void Machine::commit()
+    {
+        code_mark = code.size();
+        thunk_mark = thunks.size();
+        frame_mark = frames.size();
+        neutral_mark = neutrals.size();
+        spine_mark = spine.size();
+    }
+
+    void Machine::reset()
+    {
+        code.resize(code_mark);
+        thunks.resize(thunk_mark);
+        frames.resize(frame_mark);
+        neutrals.resize(neutral_mark);
+        spine.resize(spine_mark);
+        stack.clear();
+    }
+
+    Expression Machine::normalize(const Expression &exp, const Environment &env)
+    {
+        std::vector<std::string> scope, names;
+        // an interrupted run leaves its heaps above the marks
+        reset();
+        prepare(exp, scope, env, "");
+        auto start = code.size();
+        compile(exp, scope, env, "");
+        auto res = readback(run(start, 0, 0), names);
+        reset();
+        return res;
+    }
+}
+
+#endif